@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cache.h"
+#include "../fs/blockmap.h"
 
 // Block cache variables
 BlockCacheEntry *blockCacheLruHead;
@@ -9,6 +10,38 @@ BlockCacheEntry *blockCacheLruTail;
 int blockCacheCount;
 BlockCacheEntry *blockCacheHashHead[BLOCK_CACHESIZE];
 BlockCacheEntry *blockCacheHashTail[BLOCK_CACHESIZE];
+BlockCacheEntry *blockCacheFreeList;
+BlockCacheEntry *blockCacheA1inHead;
+BlockCacheEntry *blockCacheA1inTail;
+int blockCacheA1inCount;
+BlockCacheEntry *blockCacheDirtyHead;
+int blockCacheDirtyCount;
+int blockCacheHits;
+int blockCacheMisses;
+int blockCacheOverwrites;
+int blockCachePolicy = BLOCK_CACHE_POLICY;
+
+// Read-ahead accounting
+int readAheadIssued;
+int readAheadHits;
+int readAheadWasted;
+
+// Disk access accounting, the seek distance is the sum of |sector - previous sector| over all transfers
+int diskReads;
+int diskWrites;
+int diskSeekDistance;
+static int diskHeadPosition;
+
+// Dirty blocks gathered by SyncCache, sorted into elevator order before writing
+static BlockCacheEntry *syncBatch[BLOCK_CACHESIZE];
+
+// 2Q ghost list (A1out): block numbers recently evicted from A1in, kept as a ring buffer.
+// The ring slots are also chained by block number in a hash table, so a miss does not scan the whole ring
+static int blockCacheA1out[BLOCK_CACHE_A1OUT_SIZE];
+static int blockCacheA1outNext;
+static int blockCacheA1outHashHead[BLOCK_CACHE_A1OUT_SIZE];   // First ring slot of each bucket, -1 if empty
+static int blockCacheA1outHashNext[BLOCK_CACHE_A1OUT_SIZE];   // Links between ring slots of a bucket, -1 at the ends
+static int blockCacheA1outHashPrev[BLOCK_CACHE_A1OUT_SIZE];
 
 // Inode cache variables
 InodeCacheEntry *inodeCacheLruHead;
@@ -16,6 +49,26 @@ InodeCacheEntry *inodeCacheLruTail;
 int inodeCacheCount;
 InodeCacheEntry *inodeCacheHashHead[INODE_CACHESIZE];
 InodeCacheEntry *inodeCacheHashTail[INODE_CACHESIZE];
+InodeCacheEntry *inodeCacheFreeList;
+InodeCacheEntry *inodeCacheDirtyHead;
+int inodeCacheDirtyCount;
+int inodeBatchLoad = INODE_BATCH_LOAD;
+
+// Inode cache accounting
+int inodeCacheHits;
+int inodeCacheMisses;
+int inodeBatchLoaded;
+int inodeBatchHits;
+int inodeBatchWasted;
+
+// Fixed-capacity arenas backing the caches, so a cache miss never touches the heap.
+// Block data buffers come first so that every buffer stays BLOCKSIZE aligned.
+static struct {
+    char data[BLOCK_CACHESIZE][BLOCKSIZE];
+    BlockCacheEntry entries[BLOCK_CACHESIZE];
+} blockCacheArena __attribute__((aligned(BLOCKSIZE)));
+
+static InodeCacheEntry inodeCacheArena[INODE_CACHESIZE];
 
 /**
  * Initialize the block cache and inode cache
@@ -25,140 +78,364 @@ void InitializeCache() {
     blockCacheLruHead = NULL;
     blockCacheLruTail = NULL;
     blockCacheCount = 0;
+    blockCacheA1inHead = NULL;
+    blockCacheA1inTail = NULL;
+    blockCacheA1inCount = 0;
+    blockCacheDirtyHead = NULL;
+    blockCacheDirtyCount = 0;
+    blockCacheHits = 0;
+    blockCacheMisses = 0;
+    blockCacheOverwrites = 0;
+    readAheadIssued = 0;
+    readAheadHits = 0;
+    readAheadWasted = 0;
+    diskReads = 0;
+    diskWrites = 0;
+    diskSeekDistance = 0;
+    diskHeadPosition = 0;
+
+    // Block 0 is the boot block and never cached, so 0 marks an empty ghost slot
+    for (int i = 0; i < BLOCK_CACHE_A1OUT_SIZE; i++) {
+        blockCacheA1out[i] = 0;
+        blockCacheA1outHashHead[i] = -1;
+        blockCacheA1outHashNext[i] = -1;
+        blockCacheA1outHashPrev[i] = -1;
+    }
+    blockCacheA1outNext = 0;
 
     for (int i = 0; i < BLOCK_CACHESIZE; i++) {
         blockCacheHashHead[i] = NULL;
         blockCacheHashTail[i] = NULL;
     }
 
+    // Chain every block slot into the free list, each slot owns one data buffer of the arena
+    blockCacheFreeList = NULL;
+    for (int i = BLOCK_CACHESIZE - 1; i >= 0; i--) {
+        BlockCacheEntry *blockEntry = &blockCacheArena.entries[i];
+        memset(blockEntry, 0, sizeof(BlockCacheEntry));
+        blockEntry->data = blockCacheArena.data[i];
+        blockEntry->lruNext = blockCacheFreeList;
+        blockCacheFreeList = blockEntry;
+    }
+
     // Initialize inode cache
     inodeCacheLruHead = NULL;
     inodeCacheLruTail = NULL;
     inodeCacheCount = 0;
+    inodeCacheDirtyHead = NULL;
+    inodeCacheDirtyCount = 0;
+    inodeCacheHits = 0;
+    inodeCacheMisses = 0;
+    inodeBatchLoaded = 0;
+    inodeBatchHits = 0;
+    inodeBatchWasted = 0;
 
     for (int i = 0; i < INODE_CACHESIZE; i++) {
         inodeCacheHashHead[i] = NULL;
         inodeCacheHashTail[i] = NULL;
     }
+
+    // Chain every inode slot into the free list, the inode itself is stored inline in the slot.
+    // A block map array is kept with its slot once allocated and reused by the next inode loaded into it
+    inodeCacheFreeList = NULL;
+    for (int i = INODE_CACHESIZE - 1; i >= 0; i--) {
+        InodeCacheEntry *inodeEntry = &inodeCacheArena[i];
+        memset(inodeEntry, 0, sizeof(InodeCacheEntry));
+        inodeEntry->inodeInfo = &inodeEntry->inodeData;
+        inodeEntry->lruNext = inodeCacheFreeList;
+        inodeCacheFreeList = inodeEntry;
+    }
 }
 
-/** 
- * Sync both the block cache and inode cache to disk
+/**
+ * Unlink a slot of the A1out ring from its hash bucket and mark it empty
+ * @param slot The ring slot
  */
-void SyncCache() {
-    TracePrintf(5, "SyncCache: Syncing cache\n");
-    // Sync all inodes in the inode cache first
-    InodeCacheEntry *inodeEntry = inodeCacheLruHead;
-    while (inodeEntry) {
-        // Write the inode back to its block cache if the inode is dirty, and mark the block as dirty
-        if (inodeEntry->isDirty) {
-            TracePrintf(6, "SyncCache: Inode %d is dirty, writing back to its block cache\n", inodeEntry->inodeNumber);
-            struct BlockCacheEntry* blockEntry = GetBlockFromCache(inodeEntry->inodeNumber / INODES_PER_BLOCK + 1);
-            struct inode* overwrite = (struct inode*)(blockEntry->data) + (inodeEntry->inodeNumber % INODES_PER_BLOCK);
-            memcpy(overwrite, inodeEntry->inodeInfo, sizeof(struct inode));
-            blockEntry->isDirty = 1;
-            inodeEntry->isDirty = 0; // Mark the inode as clean after writing back
+static void RemoveGhostSlot(int slot) {
+    int next = blockCacheA1outHashNext[slot];
+    int prev = blockCacheA1outHashPrev[slot];
+    if (prev >= 0) {
+        blockCacheA1outHashNext[prev] = next;
+    }
+    else {
+        blockCacheA1outHashHead[blockCacheA1out[slot] % BLOCK_CACHE_A1OUT_SIZE] = next;
+    }
+    if (next >= 0) {
+        blockCacheA1outHashPrev[next] = prev;
+    }
+    blockCacheA1outHashNext[slot] = -1;
+    blockCacheA1outHashPrev[slot] = -1;
+    blockCacheA1out[slot] = 0;
+}
+
+/**
+ * Remember a block evicted from the 2Q A1in FIFO in the A1out ghost list, forgetting the oldest one when it is full
+ * @param blockNumber The block number evicted
+ */
+static void AddBlockToGhostList(int blockNumber) {
+    int slot = blockCacheA1outNext;
+    if (blockCacheA1out[slot] != 0) {
+        RemoveGhostSlot(slot);
+    }
+    int bucket = blockNumber % BLOCK_CACHE_A1OUT_SIZE;
+    blockCacheA1out[slot] = blockNumber;
+    blockCacheA1outHashPrev[slot] = -1;
+    blockCacheA1outHashNext[slot] = blockCacheA1outHashHead[bucket];
+    if (blockCacheA1outHashHead[bucket] >= 0) {
+        blockCacheA1outHashPrev[blockCacheA1outHashHead[bucket]] = slot;
+    }
+    blockCacheA1outHashHead[bucket] = slot;
+    blockCacheA1outNext = (blockCacheA1outNext + 1) % BLOCK_CACHE_A1OUT_SIZE;
+}
+
+/**
+ * Check whether a block was recently evicted from the 2Q A1in FIFO, and forget it if so
+ * @param blockNumber The block number to look for
+ * @return 1 if the block was found in the A1out ghost list, 0 otherwise
+ */
+static int TakeBlockFromGhostList(int blockNumber) {
+    for (int slot = blockCacheA1outHashHead[blockNumber % BLOCK_CACHE_A1OUT_SIZE]; slot >= 0; slot = blockCacheA1outHashNext[slot]) {
+        if (blockCacheA1out[slot] == blockNumber) {
+            RemoveGhostSlot(slot);
+            return 1;
         }
-        inodeEntry = inodeEntry->lruNext;
     }
+    return 0;
+}
 
-    // Then sync all blocks in the block cache
-    BlockCacheEntry *blockEntry = blockCacheLruHead;
-    while (blockEntry) {
-        // Write back to disk if the block is dirty
-        if (blockEntry->isDirty) {
-            TracePrintf(6, "SyncCache: Block %d is dirty, writing back to disk\n", blockEntry->blockNumber);
-            WriteSector(blockEntry->blockNumber, blockEntry->data);
-            blockEntry->isDirty = 0; // Mark the block as clean after writing back
+/**
+ * Walk a block list from its tail towards its head for the first entry that is not pinned.
+ * Delayed blocks have nowhere on disk to go and are passed over like pinned ones
+ * @param tail The tail of the LRU list or the A1in FIFO
+ * @return The least recently used unpinned block entry, or NULL if there is none
+ */
+static BlockCacheEntry *FindUnpinnedBlock(BlockCacheEntry *tail) {
+    while (tail && (tail->pinCount > 0 || tail->delayed)) {
+        tail = tail->lruPrev;
+    }
+    return tail;
+}
+
+/**
+ * Get an unused block cache slot from the pool.
+ * If the pool is exhausted, the least recently used unpinned block is evicted and its slot is recycled in place.
+ * @return The block entry slot, with its data buffer still attached, or NULL if every block is pinned
+ */
+static BlockCacheEntry *AllocateBlockCacheSlot() {
+    if (blockCacheFreeList == NULL) {
+        TracePrintf(6, "AllocateBlockCacheSlot: Current block cache is full with %d blocks, recycling tail\n", blockCacheCount);
+        BlockCacheEntry *a1inVictim = FindUnpinnedBlock(blockCacheA1inTail);
+        BlockCacheEntry *lruVictim = FindUnpinnedBlock(blockCacheLruTail);
+        // Under 2Q, reclaim from A1in once it exceeds its share, remembering the block in A1out
+        if (a1inVictim != NULL && (blockCacheA1inCount > BLOCK_CACHE_A1IN_SIZE || lruVictim == NULL)) {
+            AddBlockToGhostList(a1inVictim->blockNumber);
+            EvictBlockFromCache(a1inVictim);
+        }
+        else if (lruVictim != NULL) {
+            EvictBlockFromCache(lruVictim);
+        }
+        else {
+            TracePrintf(0, "AllocateBlockCacheSlot: Every block in the cache is pinned\n");
+            return NULL;
         }
-        blockEntry = blockEntry->lruNext;
     }
-    TracePrintf(5, "SyncCache: Finish syncing cache\n");
+    BlockCacheEntry *blockEntry = blockCacheFreeList;
+    blockCacheFreeList = blockEntry->lruNext;
+    return blockEntry;
 }
 
 /**
- * Add a blockEntry to the top of the LRU cache and the hash table
- * @param blockEntry The block entry to add
+ * Get an unused inode cache slot from the pool.
+ * If the pool is exhausted, the least recently used unpinned inode that can be evicted is evicted and its slot
+ * is recycled in place. An inode whose delayed blocks cannot get their disk blocks, or that cannot be written back,
+ * stays cached and the next one is tried
+ * @return The inode entry slot, with inodeInfo pointing to its inline inode, or NULL if no inode can be evicted
  */
-void AddBlockToCache(BlockCacheEntry *blockEntry) {
-    TracePrintf(6, "AddBlockToCache: Adding block %d to cache\n", blockEntry->blockNumber);
-    PrintBlockLRUCache();
-    if (blockCacheCount == BLOCK_CACHESIZE) {
-        TracePrintf(6, "AddBlockToCache: Current block cache is full with %d blocks, removing tail\n", blockCacheCount);
-        EvictBlockFromCache(blockCacheLruTail);
+static InodeCacheEntry *AllocateInodeCacheSlot() {
+    if (inodeCacheFreeList == NULL) {
+        TracePrintf(6, "AllocateInodeCacheSlot: Current inode cache is full with %d inodes, recycling tail\n", inodeCacheCount);
+        InodeCacheEntry *victim = inodeCacheLruTail;
+        while (victim && (victim->pinCount > 0 || EvictInodeFromCache(victim) == ERROR)) {
+            victim = victim->lruPrev;
+        }
+        if (victim == NULL) {
+            TracePrintf(0, "AllocateInodeCacheSlot: Every inode in the cache is pinned or cannot be evicted\n");
+            return NULL;
+        }
     }
+    InodeCacheEntry *inodeEntry = inodeCacheFreeList;
+    inodeCacheFreeList = inodeEntry->lruNext;
+    return inodeEntry;
+}
 
-    // Add to the top of the LRU linked list
-    if (blockCacheLruHead == NULL) {
-        TracePrintf(6, "AddBlockToCache: Current block cache is empty, add to head and tail\n");
-        blockCacheLruHead = blockEntry;
-        blockCacheLruTail = blockEntry;
-    } 
-    else {
-        TracePrintf(6, "AddBlockToCache: Add to head of the cache\n");
-        blockEntry->lruNext = blockCacheLruHead;
-        blockCacheLruHead->lruPrev = blockEntry;
-        blockCacheLruHead = blockEntry;
+/**
+ * Move the simulated disk head to a sector, accumulating the seek distance
+ * @param sectorNumber The sector being transferred
+ */
+static void SeekTo(int sectorNumber) {
+    diskSeekDistance += (sectorNumber > diskHeadPosition) ? sectorNumber - diskHeadPosition : diskHeadPosition - sectorNumber;
+    diskHeadPosition = sectorNumber;
+}
+
+/**
+ * ReadSector with disk access accounting
+ * @param sectorNumber The sector to read
+ * @param buf The buffer to read into
+ * @return The result of ReadSector
+ */
+static int DiskReadSector(int sectorNumber, void *buf) {
+    SeekTo(sectorNumber);
+    diskReads += 1;
+    return ReadSector(sectorNumber, buf);
+}
+
+/**
+ * WriteSector with disk access accounting
+ * @param sectorNumber The sector to write
+ * @param buf The buffer to write from
+ * @return The result of WriteSector
+ */
+static int DiskWriteSector(int sectorNumber, void *buf) {
+    SeekTo(sectorNumber);
+    diskWrites += 1;
+    return WriteSector(sectorNumber, buf);
+}
+
+/**
+ * Take a block entry off the dirty list and mark it clean
+ * @param blockEntry The block entry to mark clean
+ */
+static void MarkBlockEntryClean(BlockCacheEntry *blockEntry) {
+    if (!blockEntry->isDirty) {
+        return;
+    }
+    if (blockEntry->dirtyPrev) {
+        blockEntry->dirtyPrev->dirtyNext = blockEntry->dirtyNext;
+    } else {
+        blockCacheDirtyHead = blockEntry->dirtyNext;
+    }
+    if (blockEntry->dirtyNext) {
+        blockEntry->dirtyNext->dirtyPrev = blockEntry->dirtyPrev;
     }
+    blockEntry->dirtyPrev = NULL;
+    blockEntry->dirtyNext = NULL;
+    blockEntry->isDirty = 0;
+    blockCacheDirtyCount -= 1;
+}
 
-    // Add to the hash table
-    // If collision occurs, add to the top of the linked list
+/**
+ * Take an inode entry off the dirty list and mark it clean
+ * @param inodeEntry The inode entry to mark clean
+ */
+static void MarkInodeEntryClean(InodeCacheEntry *inodeEntry) {
+    if (!inodeEntry->isDirty) {
+        return;
+    }
+    if (inodeEntry->dirtyPrev) {
+        inodeEntry->dirtyPrev->dirtyNext = inodeEntry->dirtyNext;
+    } else {
+        inodeCacheDirtyHead = inodeEntry->dirtyNext;
+    }
+    if (inodeEntry->dirtyNext) {
+        inodeEntry->dirtyNext->dirtyPrev = inodeEntry->dirtyPrev;
+    }
+    inodeEntry->dirtyPrev = NULL;
+    inodeEntry->dirtyNext = NULL;
+    inodeEntry->isDirty = 0;
+    inodeCacheDirtyCount -= 1;
+}
+
+/**
+ * Copy a cached inode back into its inode block in the block cache, and mark the block as dirty
+ * @param inodeEntry The inode entry to write back
+ * @return 0 on success, ERROR if the inode block could not be brought into the cache
+ */
+static int WriteBackInode(InodeCacheEntry *inodeEntry) {
+    struct BlockCacheEntry* blockEntry = GetBlockFromCache(inodeEntry->inodeNumber / INODES_PER_BLOCK + 1);
+    if (blockEntry == NULL) {
+        TracePrintf(0, "WriteBackInode: Cannot load the block of inode %d\n", inodeEntry->inodeNumber);
+        return ERROR;
+    }
+    struct inode* overwrite = (struct inode*)(blockEntry->data) + (inodeEntry->inodeNumber % INODES_PER_BLOCK);
+    memcpy(overwrite, inodeEntry->inodeInfo, sizeof(struct inode));
+    MarkBlockEntryDirty(blockEntry);
+    return 0;
+}
+
+/** 
+ * Sync both the block cache and inode cache to disk.
+ * Only the dirty lists are walked, so the cost is proportional to the number of dirty entries
+ */
+void SyncCache() {
+    TracePrintf(5, "SyncCache: Syncing cache, %d dirty inodes and %d dirty blocks\n", inodeCacheDirtyCount, blockCacheDirtyCount);
+    // Give every delayed block a disk block first, this dirties the inodes and indirect blocks involved
+    AllocateAllDelayedBlocks();
+
+    // Sync all dirty inodes first, writing them back to their block cache and marking the blocks as dirty.
+    // An inode whose block cannot be loaded stays dirty for the next sync
+    InodeCacheEntry *nextDirty;
+    for (InodeCacheEntry *inodeEntry = inodeCacheDirtyHead; inodeEntry; inodeEntry = nextDirty) {
+        nextDirty = inodeEntry->dirtyNext;
+        TracePrintf(6, "SyncCache: Inode %d is dirty, writing back to its block cache\n", inodeEntry->inodeNumber);
+        if (WriteBackInode(inodeEntry) == 0) {
+            MarkInodeEntryClean(inodeEntry); // Mark the inode as clean after writing back
+        }
+    }
+
+    // Then write all dirty blocks back to disk in elevator (C-LOOK) order: gather them, sort by block number,
+    // and sweep upwards from the current head position before wrapping around to the lowest block
+    int count = 0;
+    for (BlockCacheEntry *blockEntry = blockCacheDirtyHead; blockEntry; blockEntry = blockEntry->dirtyNext) {
+        // A delayed block whose allocation failed has no sector to go to
+        if (blockEntry->delayed) {
+            continue;
+        }
+        // Insertion sort, the batch is at most BLOCK_CACHESIZE entries
+        int i = count++;
+        while (i > 0 && syncBatch[i - 1]->blockNumber > blockEntry->blockNumber) {
+            syncBatch[i] = syncBatch[i - 1];
+            i--;
+        }
+        syncBatch[i] = blockEntry;
+    }
+    int start = 0;
+    while (start < count && syncBatch[start]->blockNumber < diskHeadPosition) {
+        start++;
+    }
+    for (int i = 0; i < count; i++) {
+        BlockCacheEntry *blockEntry = syncBatch[(start + i) % count];
+        TracePrintf(6, "SyncCache: Block %d is dirty, writing back to disk\n", blockEntry->blockNumber);
+        DiskWriteSector(blockEntry->blockNumber, blockEntry->data);
+        MarkBlockEntryClean(blockEntry); // Mark the block as clean after writing back
+    }
+    TracePrintf(5, "SyncCache: Finish syncing cache\n");
+}
+
+/**
+ * Add a blockEntry to the hash table under its block number.
+ * If collision occurs, add to the top of the linked list
+ * @param blockEntry The block entry to add
+ */
+static void HashBlock(BlockCacheEntry *blockEntry) {
     int hashIndex = blockEntry->blockNumber % BLOCK_CACHESIZE;
     if (blockCacheHashHead[hashIndex] == NULL) {
-        TracePrintf(6, "AddBlockToCache: Add to hash table head\n");
+        TracePrintf(6, "HashBlock: Add to hash table head\n");
         blockCacheHashHead[hashIndex] = blockEntry;
         blockCacheHashTail[hashIndex] = blockEntry;
     } 
     else {
-        TracePrintf(6, "AddBlockToCache: Hash collision occurs, add to linked list\n");
+        TracePrintf(6, "HashBlock: Hash collision occurs, add to linked list\n");
         blockEntry->hashNext = blockCacheHashHead[hashIndex];
         blockCacheHashHead[hashIndex]->hashPrev = blockEntry;
         blockCacheHashHead[hashIndex] = blockEntry;
     }
-
-    blockCacheCount += 1;
-    PrintBlockLRUCache();
 }
 
 /**
- * Evict a blockEntry from the LRU cache and the hash table.
- * Write back to disk if the block is dirty
+ * Remove a blockEntry from the hash table
  * @param blockEntry The block entry to remove
  */
-void EvictBlockFromCache(BlockCacheEntry *blockEntry) {
-    TracePrintf(6, "EvictBlockFromCache: Evicting block %d from cache\n", blockEntry->blockNumber);
-    PrintBlockLRUCache();
-    // Write back to disk if the block is dirty
-    if (blockEntry->isDirty) {
-        TracePrintf(6, "EvictBlockFromCache: Block %d is dirty, writing back to disk\n", blockEntry->blockNumber);
-        WriteSector(blockEntry->blockNumber, blockEntry->data);
-    }
-
-    // Remove from the LRU linked list
-    TracePrintf(6, "EvictBlockFromCache: Removing block %d from LRU linked list\n", blockEntry->blockNumber);
-    if (blockEntry->lruNext == NULL && blockEntry->lruPrev == NULL) {
-        // This is the only entry in the list
-        blockCacheLruHead = NULL;
-        blockCacheLruTail = NULL;
-    } 
-    else if (blockEntry->lruNext == NULL) {
-        // This is the tail of the list
-        blockCacheLruTail = blockEntry->lruPrev;
-        blockCacheLruTail->lruNext = NULL;
-    } 
-    else if (blockEntry->lruPrev == NULL) {
-        // This is the head of the list
-        blockCacheLruHead = blockEntry->lruNext;
-        blockCacheLruHead->lruPrev = NULL;
-    } 
-    else {
-        // This is in the middle of the list
-        blockEntry->lruPrev->lruNext = blockEntry->lruNext;
-        blockEntry->lruNext->lruPrev = blockEntry->lruPrev;
-    }
-
-    // Remove from the hash table
-    TracePrintf(6, "EvictBlockFromCache: Removing block %d from hash table\n", blockEntry->blockNumber);
+static void UnhashBlock(BlockCacheEntry *blockEntry) {
     int hashIndex = blockEntry->blockNumber % BLOCK_CACHESIZE;
     if (blockEntry->hashNext == NULL && blockEntry->hashPrev == NULL) {
         // This is the only entry in the list
@@ -180,11 +457,258 @@ void EvictBlockFromCache(BlockCacheEntry *blockEntry) {
         blockEntry->hashPrev->hashNext = blockEntry->hashNext;
         blockEntry->hashNext->hashPrev = blockEntry->hashPrev;
     }
+    blockEntry->hashPrev = NULL;
+    blockEntry->hashNext = NULL;
+}
+
+/**
+ * Add a blockEntry to the top of the LRU cache and the hash table
+ * @param blockEntry The block entry to add
+ */
+void AddBlockToCache(BlockCacheEntry *blockEntry) {
+    TracePrintf(6, "AddBlockToCache: Adding block %d to cache\n", blockEntry->blockNumber);
+    PrintBlockLRUCache();
+
+    // Add to the top of the LRU linked list, or of the A1in FIFO for a 2Q first reference
+    BlockCacheEntry **head = (blockEntry->queue == BLOCK_QUEUE_A1IN) ? &blockCacheA1inHead : &blockCacheLruHead;
+    BlockCacheEntry **tail = (blockEntry->queue == BLOCK_QUEUE_A1IN) ? &blockCacheA1inTail : &blockCacheLruTail;
+    if (*head == NULL) {
+        TracePrintf(6, "AddBlockToCache: Current block cache is empty, add to head and tail\n");
+        *head = blockEntry;
+        *tail = blockEntry;
+    } 
+    else {
+        TracePrintf(6, "AddBlockToCache: Add to head of the cache\n");
+        blockEntry->lruNext = *head;
+        (*head)->lruPrev = blockEntry;
+        *head = blockEntry;
+    }
+    if (blockEntry->queue == BLOCK_QUEUE_A1IN) {
+        blockCacheA1inCount += 1;
+    }
+
+    // Add to the hash table
+    HashBlock(blockEntry);
+
+    blockCacheCount += 1;
+    PrintBlockLRUCache();
+}
+
+/**
+ * Unlink a blockEntry from the list of its queue (LRU list or A1in FIFO)
+ * @param blockEntry The block entry to unlink
+ */
+static void UnlinkBlockFromQueue(BlockCacheEntry *blockEntry) {
+    BlockCacheEntry **head = (blockEntry->queue == BLOCK_QUEUE_A1IN) ? &blockCacheA1inHead : &blockCacheLruHead;
+    BlockCacheEntry **tail = (blockEntry->queue == BLOCK_QUEUE_A1IN) ? &blockCacheA1inTail : &blockCacheLruTail;
+    if (blockEntry->lruNext == NULL && blockEntry->lruPrev == NULL) {
+        // This is the only entry in the list
+        *head = NULL;
+        *tail = NULL;
+    } 
+    else if (blockEntry->lruNext == NULL) {
+        // This is the tail of the list
+        *tail = blockEntry->lruPrev;
+        (*tail)->lruNext = NULL;
+    } 
+    else if (blockEntry->lruPrev == NULL) {
+        // This is the head of the list
+        *head = blockEntry->lruNext;
+        (*head)->lruPrev = NULL;
+    } 
+    else {
+        // This is in the middle of the list
+        blockEntry->lruPrev->lruNext = blockEntry->lruNext;
+        blockEntry->lruNext->lruPrev = blockEntry->lruPrev;
+    }
+    blockEntry->lruPrev = NULL;
+    blockEntry->lruNext = NULL;
+    if (blockEntry->queue == BLOCK_QUEUE_A1IN) {
+        blockCacheA1inCount -= 1;
+    }
+}
+
+/**
+ * Record a reference to a cached block.
+ * An Am block moves to the head of the LRU list. A 2Q A1in block stays where it is: A1in is a FIFO, and
+ * it is never promoted into Am on a hit either, only a miss that finds the block in A1out does. So a burst
+ * of references from one scan neither keeps the block in A1in longer nor brings it into Am. A block a
+ * handler is still using is pinned, which keeps it from being evicted from A1in
+ * @param blockEntry The block entry referenced
+ */
+static void ReferenceBlock(BlockCacheEntry *blockEntry) {
+    if (blockEntry->queue == BLOCK_QUEUE_A1IN) {
+        return;
+    }
+    MoveBlockToHead(blockEntry);
+}
 
-    free(blockEntry->data);
-    free(blockEntry);
+/**
+ * Take a blockEntry out of its queue and the hash table and return its slot to the pool, without writing it back
+ * @param blockEntry The block entry to remove
+ */
+static void RemoveBlockFromCache(BlockCacheEntry *blockEntry) {
+    // Remove from the LRU linked list (or the A1in FIFO)
+    TracePrintf(6, "RemoveBlockFromCache: Removing block %d from LRU linked list\n", blockEntry->blockNumber);
+    UnlinkBlockFromQueue(blockEntry);
+
+    // Remove from the hash table
+    TracePrintf(6, "RemoveBlockFromCache: Removing block %d from hash table\n", blockEntry->blockNumber);
+    UnhashBlock(blockEntry);
+
+    // Return the slot to the pool, the data buffer stays attached to the slot
+    blockEntry->lruPrev = NULL;
+    blockEntry->lruNext = blockCacheFreeList;
+    blockCacheFreeList = blockEntry;
     blockCacheCount -= 1;
+}
+
+/**
+ * Evict a blockEntry from the LRU cache and the hash table.
+ * Write back to disk if the block is dirty
+ * @param blockEntry The block entry to remove
+ */
+void EvictBlockFromCache(BlockCacheEntry *blockEntry) {
+    TracePrintf(6, "EvictBlockFromCache: Evicting block %d from cache\n", blockEntry->blockNumber);
     PrintBlockLRUCache();
+    // Write back to disk if the block is dirty
+    if (blockEntry->isDirty) {
+        TracePrintf(6, "EvictBlockFromCache: Block %d is dirty, writing back to disk\n", blockEntry->blockNumber);
+        DiskWriteSector(blockEntry->blockNumber, blockEntry->data);
+        MarkBlockEntryClean(blockEntry);
+    }
+    if (blockEntry->prefetched) {
+        TracePrintf(6, "EvictBlockFromCache: Block %d was read ahead but never used\n", blockEntry->blockNumber);
+        readAheadWasted += 1;
+        blockEntry->prefetched = 0;
+    }
+
+    RemoveBlockFromCache(blockEntry);
+    PrintBlockLRUCache();
+}
+
+/**
+ * Bring a block that is not cached into a free cache slot
+ * @param blockNumber The block number to load
+ * @param readFromDisk If 0 the slot is zero filled instead of read, for a block about to be overwritten
+ * @return The new block entry, or NULL if every cached block is pinned
+ */
+static BlockCacheEntry *LoadBlockIntoCache(int blockNumber, int readFromDisk) {
+    BlockCacheEntry *blockEntry = AllocateBlockCacheSlot();
+    if (blockEntry == NULL) {
+        return NULL;
+    }
+    blockEntry->blockNumber = blockNumber;
+    blockEntry->prefetched = 0;
+    blockEntry->pinCount = 0;
+    blockEntry->delayed = 0;
+    blockEntry->queue = BLOCK_QUEUE_AM;
+    if (blockCachePolicy == CACHE_POLICY_2Q && !TakeBlockFromGhostList(blockNumber)) {
+        // First reference (or not re-referenced soon enough), admit through the A1in FIFO
+        blockEntry->queue = BLOCK_QUEUE_A1IN;
+    }
+    blockEntry->lruPrev = NULL;
+    blockEntry->lruNext = NULL;
+    blockEntry->hashPrev = NULL;
+    blockEntry->hashNext = NULL;
+    if (readFromDisk) {
+        DiskReadSector(blockNumber, blockEntry->data);
+        TracePrintf(6, "LoadBlockIntoCache: Block %d read from disk\n", blockNumber);
+    }
+    else {
+        memset(blockEntry->data, 0, BLOCKSIZE);
+        TracePrintf(6, "LoadBlockIntoCache: Block %d zero filled without reading disk\n", blockNumber);
+    }
+
+    // Add the block to the cache
+    AddBlockToCache(blockEntry);
+    return blockEntry;
+}
+
+/**
+ * Find a block in the cache without referencing it
+ * @param blockNumber The block number to look for
+ * @return The block entry, or NULL if the block is not cached
+ */
+static BlockCacheEntry *LookupBlockInCache(int blockNumber) {
+    BlockCacheEntry *blockEntry = blockCacheHashHead[blockNumber % BLOCK_CACHESIZE];
+    while (blockEntry) {
+        if (blockEntry->blockNumber == blockNumber) {
+            return blockEntry;
+        }
+        blockEntry = blockEntry->hashNext;
+    }
+    return NULL;
+}
+
+/**
+ * Get a delayed block from the cache
+ * @param key The DELAYED_BLOCK_KEY of the block
+ * @return The block entry, or NULL if there is no such delayed block
+ */
+static BlockCacheEntry *GetDelayedBlock(int key) {
+    BlockCacheEntry *blockEntry = LookupBlockInCache(key);
+    if (blockEntry == NULL) {
+        TracePrintf(0, "GetDelayedBlock: No delayed block %x in the cache\n", key);
+        return NULL;
+    }
+    blockCacheHits += 1;
+    ReferenceBlock(blockEntry);
+    return blockEntry;
+}
+
+/**
+ * Set up a zero filled cache entry for a file block that has no disk block yet.
+ * The entry is never evicted, it stays until AssignDelayedBlock or DropDelayedBlock
+ * @param key The DELAYED_BLOCK_KEY of the block
+ * @return The block entry, or NULL if every cached block is pinned or delayed
+ */
+BlockCacheEntry *CreateDelayedBlock(int key) {
+    BlockCacheEntry *blockEntry = LoadBlockIntoCache(key, 0);
+    if (blockEntry == NULL) {
+        return NULL;
+    }
+    blockEntry->delayed = 1;
+    return blockEntry;
+}
+
+/**
+ * Give a delayed block the disk block allocated for it. The entry is rehashed under the block number and
+ * marked dirty, so its data reaches the disk with the next write-back. A stale cached copy of the disk
+ * block, left from a file that freed it, is dropped
+ * @param blockEntry The delayed block entry
+ * @param blockNumber The disk block allocated for it
+ * @return 0 on success, ERROR if the block number is invalid
+ */
+int AssignDelayedBlock(BlockCacheEntry *blockEntry, int blockNumber) {
+    if (blockNumber <= 0 || blockNumber >= fsHeader->num_blocks) {
+        return ERROR;
+    }
+    BlockCacheEntry *stale = LookupBlockInCache(blockNumber);
+    if (stale != NULL) {
+        MarkBlockEntryClean(stale);
+        RemoveBlockFromCache(stale);
+    }
+    TracePrintf(6, "AssignDelayedBlock: Delayed block %x becomes block %d\n", blockEntry->blockNumber, blockNumber);
+    UnhashBlock(blockEntry);
+    blockEntry->blockNumber = blockNumber;
+    blockEntry->delayed = 0;
+    HashBlock(blockEntry);
+    MarkBlockEntryDirty(blockEntry);
+    return 0;
+}
+
+/**
+ * Throw away a delayed block, for a file shrunk before the block got a disk block
+ * @param key The DELAYED_BLOCK_KEY of the block
+ */
+void DropDelayedBlock(int key) {
+    BlockCacheEntry *blockEntry = LookupBlockInCache(key);
+    if (blockEntry == NULL) {
+        return;
+    }
+    MarkBlockEntryClean(blockEntry);
+    RemoveBlockFromCache(blockEntry);
 }
 
 /**
@@ -196,6 +720,11 @@ void EvictBlockFromCache(BlockCacheEntry *blockEntry) {
 BlockCacheEntry *GetBlockFromCache(int blockNumber) {
     TracePrintf(6, "GetBlockFromCache: Getting block %d from cache\n", blockNumber);
     
+    // A delayed block only exists in the cache. Negative numbers have the flag bit set too, they are invalid
+    if (blockNumber > 0 && (blockNumber & DELAYED_BLOCK_FLAG)) {
+        return GetDelayedBlock(blockNumber);
+    }
+
     // Check if blockNumber is valid
     if (blockNumber < 0 || blockNumber >= fsHeader->num_blocks) {
         TracePrintf(6, "GetBlockFromCache: Invalid block number %d\n", blockNumber);
@@ -203,52 +732,91 @@ BlockCacheEntry *GetBlockFromCache(int blockNumber) {
     }
 
     // Find the block in the cache first
-    int hashIndex = blockNumber % BLOCK_CACHESIZE;
-    BlockCacheEntry *blockEntry = blockCacheHashHead[hashIndex];
-    while (blockEntry) {
-        if (blockEntry->blockNumber == blockNumber) {
-            TracePrintf(6, "GetBlockFromCache: Block %d found in cache\n", blockNumber);
-            MoveBlockToHead(blockEntry);
-            return blockEntry;
+    BlockCacheEntry *blockEntry = LookupBlockInCache(blockNumber);
+    if (blockEntry) {
+        TracePrintf(6, "GetBlockFromCache: Block %d found in cache\n", blockNumber);
+        blockCacheHits += 1;
+        if (blockEntry->prefetched) {
+            readAheadHits += 1;
+            blockEntry->prefetched = 0;
         }
-        blockEntry = blockEntry->hashNext;
+        ReferenceBlock(blockEntry);
+        return blockEntry;
     }
 
     // If the block is not in the cache, read it from disk
     TracePrintf(6, "GetBlockFromCache: Block %d not found in cache, reading from disk\n", blockNumber);
-    blockEntry = malloc(sizeof(BlockCacheEntry));
-    blockEntry->blockNumber = blockNumber;
-    blockEntry->isDirty = 0;
-    blockEntry->lruPrev = NULL;
-    blockEntry->lruNext = NULL;
-    blockEntry->hashPrev = NULL;
-    blockEntry->hashNext = NULL;
-    blockEntry->data = malloc(BLOCKSIZE);
-    ReadSector(blockNumber, blockEntry->data);
-    TracePrintf(6, "GetBlockFromCache: Block %d read from disk\n", blockNumber);
+    blockCacheMisses += 1;
+    return LoadBlockIntoCache(blockNumber, 1);
+}
 
-    // Add the block to the cache
-    AddBlockToCache(blockEntry);
+/**
+ * Get a block from the cache that the caller is about to overwrite completely (a newly allocated block,
+ * or a write covering the whole block). A cached block is returned as is, otherwise a zero filled
+ * entry is set up without reading the old contents from disk. The caller marks the entry dirty
+ * @param blockNumber The block number to get
+ * @return The block entry from the cache, or NULL on failure
+ */
+BlockCacheEntry *GetBlockForOverwrite(int blockNumber) {
+    TracePrintf(6, "GetBlockForOverwrite: Getting block %d from cache\n", blockNumber);
+    if (blockNumber > 0 && (blockNumber & DELAYED_BLOCK_FLAG)) {
+        return GetDelayedBlock(blockNumber);
+    }
+    if (blockNumber < 0 || blockNumber >= fsHeader->num_blocks) {
+        TracePrintf(6, "GetBlockForOverwrite: Invalid block number %d\n", blockNumber);
+        return NULL;
+    }
 
-    return blockEntry;
+    BlockCacheEntry *blockEntry = LookupBlockInCache(blockNumber);
+    if (blockEntry) {
+        blockCacheHits += 1;
+        if (blockEntry->prefetched) {
+            readAheadHits += 1;
+            blockEntry->prefetched = 0;
+        }
+        ReferenceBlock(blockEntry);
+        return blockEntry;
+    }
+    blockCacheOverwrites += 1;
+    return LoadBlockIntoCache(blockNumber, 0);
 }
 
 /**
- * Move a block entry to the head of the LRU linked list
+ * Read a block into the cache ahead of its use.
+ * A block that is already cached is left where it is, so read-ahead never refreshes a block's recency
+ * @param blockNumber The block number to prefetch
+ */
+void PrefetchBlock(int blockNumber) {
+    if (blockNumber <= 0 || blockNumber >= fsHeader->num_blocks || LookupBlockInCache(blockNumber)) {
+        return;
+    }
+    TracePrintf(6, "PrefetchBlock: Reading ahead block %d\n", blockNumber);
+    BlockCacheEntry *blockEntry = LoadBlockIntoCache(blockNumber, 1);
+    if (blockEntry == NULL) {
+        return;
+    }
+    blockEntry->prefetched = 1;
+    readAheadIssued += 1;
+}
+
+/**
+ * Move a block entry to the head of its list (the LRU list, or the A1in FIFO under 2Q)
  * @param blockEntry The block entry to move
  */
 void MoveBlockToHead(BlockCacheEntry *blockEntry) {
     TracePrintf(6, "MoveBlockToHead: Moving block %d to head of LRU linked list\n", blockEntry->blockNumber);
     PrintBlockLRUCache();
+    BlockCacheEntry **head = (blockEntry->queue == BLOCK_QUEUE_A1IN) ? &blockCacheA1inHead : &blockCacheLruHead;
+    BlockCacheEntry **tail = (blockEntry->queue == BLOCK_QUEUE_A1IN) ? &blockCacheA1inTail : &blockCacheLruTail;
     // Return directly if the block is already at the head
-    if (blockEntry == blockCacheLruHead) {
+    if (blockEntry == *head) {
         return;
     }
 
     // if this was the tail, fix up the tail pointer
-    if (blockEntry == blockCacheLruTail) {
-        blockCacheLruTail = blockEntry->lruPrev;
-        blockCacheLruTail->lruNext = NULL;
+    if (blockEntry == *tail) {
+        *tail = blockEntry->lruPrev;
+        (*tail)->lruNext = NULL;
     }
 
     if (blockEntry->lruPrev) {
@@ -258,10 +826,10 @@ void MoveBlockToHead(BlockCacheEntry *blockEntry) {
         blockEntry->lruNext->lruPrev = blockEntry->lruPrev;
     }
 
-    blockEntry->lruNext = blockCacheLruHead;
-    blockCacheLruHead->lruPrev = blockEntry;
+    blockEntry->lruNext = *head;
+    (*head)->lruPrev = blockEntry;
     blockEntry->lruPrev = NULL;
-    blockCacheLruHead = blockEntry;
+    *head = blockEntry;
     PrintBlockLRUCache();
 }
 
@@ -277,8 +845,8 @@ void MarkBlockDirty(int blockNumber) {
     while (blockEntry) {
         if (blockEntry->blockNumber == blockNumber) {
             TracePrintf(6, "MarkBlockDirty: Block %d found in cache\n", blockNumber);
-            MoveBlockToHead(blockEntry);
-            blockEntry->isDirty = 1;
+            ReferenceBlock(blockEntry);
+            MarkBlockEntryDirty(blockEntry);
             return;
         }
         blockEntry = blockEntry->hashNext;
@@ -287,6 +855,24 @@ void MarkBlockDirty(int blockNumber) {
     TracePrintf(6, "MarkBlockDirty: Block %d not found in cache\n", blockNumber);
 }
 
+/**
+ * Mark a cached block as dirty and put it on the dirty list, without changing its position in the LRU
+ * @param blockEntry The block entry to mark as dirty
+ */
+void MarkBlockEntryDirty(BlockCacheEntry *blockEntry) {
+    if (blockEntry->isDirty) {
+        return;
+    }
+    blockEntry->isDirty = 1;
+    blockEntry->dirtyPrev = NULL;
+    blockEntry->dirtyNext = blockCacheDirtyHead;
+    if (blockCacheDirtyHead) {
+        blockCacheDirtyHead->dirtyPrev = blockEntry;
+    }
+    blockCacheDirtyHead = blockEntry;
+    blockCacheDirtyCount += 1;
+}
+
 // ===============================================================================================
 
 /**
@@ -301,10 +887,6 @@ void AddInodeToCache(InodeCacheEntry *inodeEntry) {
 
     TracePrintf(6, "AddInodeToCache: Adding inode %d to cache\n", inodeEntry->inodeNumber);
     PrintInodeLRUCache();
-    if (inodeCacheCount == INODE_CACHESIZE) {
-        TracePrintf(6, "AddInodeToCache: Current inode cache is full with %d inodes, removing tail\n", inodeCacheCount);
-        EvictInodeFromCache(inodeCacheLruTail);
-    }
 
     // Add to the top of the LRU linked list
     if (inodeCacheLruHead == NULL) {
@@ -343,19 +925,35 @@ void AddInodeToCache(InodeCacheEntry *inodeEntry) {
  * Evict an inode Entry from the LRU cache and the hash table.
  * Write back to its block in cache if the inode is dirty
  * @param inodeEntry The inode entry to remove
+ * @return 0 on success, ERROR if its delayed blocks could not all get disk blocks or it could not be written back,
+ * the inode then stays cached
  */
-void EvictInodeFromCache(InodeCacheEntry *inodeEntry) {
+int EvictInodeFromCache(InodeCacheEntry *inodeEntry) {
     TracePrintf(6, "EvictInodeFromCache: Evicting inode %d from cache\n", inodeEntry->inodeNumber);
-    
+
+    // Delayed blocks are keyed by the slot, the slot can only be reused once they all have their disk blocks
+    if (AllocateDelayedBlocks(inodeEntry) == ERROR) {
+        TracePrintf(0, "EvictInodeFromCache: Inode %d still has %d delayed blocks, keeping it cached\n",
+            inodeEntry->inodeNumber, inodeEntry->delayedBlocks);
+        return ERROR;
+    }
     // Write the inode back to its block cache if the inode is dirty, and mark the block as dirty
     if (inodeEntry->isDirty) {
         TracePrintf(6, "EvictInodeFromCache: Inode %d is dirty, writing back to its block cache\n", inodeEntry->inodeNumber);
-        struct BlockCacheEntry* blockEntry = GetBlockFromCache(inodeEntry->inodeNumber / INODES_PER_BLOCK + 1);
-        struct inode* overwrite = (struct inode*)(blockEntry->data) + (inodeEntry->inodeNumber % INODES_PER_BLOCK);
-        memcpy(overwrite, inodeEntry->inodeInfo, sizeof(struct inode));
-        blockEntry->isDirty = 1;
+        if (WriteBackInode(inodeEntry) == ERROR) {
+            TracePrintf(0, "EvictInodeFromCache: Inode %d could not be written back, keeping it cached\n", inodeEntry->inodeNumber);
+            return ERROR;
+        }
+        MarkInodeEntryClean(inodeEntry);
     }
     
+    // Blocks held back for the file go back to the free map, its next allocation would reserve them anew
+    ReleaseBlockReservation(inodeEntry);
+    if (inodeEntry->batchLoaded) {
+        inodeBatchWasted += 1;
+        inodeEntry->batchLoaded = 0;
+    }
+
     // Remove from the LRU linked list
     TracePrintf(6, "EvictInodeFromCache: Removing inode %d from LRU linked list\n", inodeEntry->inodeNumber);
     if (inodeEntry->lruNext == NULL && inodeEntry->lruPrev == NULL) {
@@ -403,14 +1001,146 @@ void EvictInodeFromCache(InodeCacheEntry *inodeEntry) {
         inodeEntry->hashNext->hashPrev = inodeEntry->hashPrev;
     }
 
-    free(inodeEntry->inodeInfo);
-    free(inodeEntry);
+    // Return the slot to the pool
+    inodeEntry->lruPrev = NULL;
+    inodeEntry->hashPrev = NULL;
+    inodeEntry->hashNext = NULL;
+    inodeEntry->lruNext = inodeCacheFreeList;
+    inodeCacheFreeList = inodeEntry;
     inodeCacheCount -= 1;
+    return 0;
+}
+
+/**
+ * Fill a free inode cache slot with an inode copied out of its inode block
+ * @param inodeEntry The free slot
+ * @param inodeNumber The inode number
+ * @param inodeInfo The inode in the inode block
+ */
+static void FillInodeCacheEntry(InodeCacheEntry *inodeEntry, int inodeNumber, struct inode *inodeInfo) {
+    inodeEntry->inodeNumber = inodeNumber;
+    inodeEntry->pinCount = 0;
+    inodeEntry->batchLoaded = 0;
+    inodeEntry->blockCursor = -1;
+    inodeEntry->blockMapValid = 0;
+    inodeEntry->treeRoots[0] = -1;
+    inodeEntry->treeRoots[1] = -1;
+    inodeEntry->allocReserveNext = 0;
+    inodeEntry->allocReserveEnd = 0;
+    inodeEntry->delayedStart = 0;
+    inodeEntry->delayedBlocks = 0;
+    inodeEntry->delayedPromise = 0;
+    inodeEntry->dirEntryCount = -1;
+    inodeEntry->dirFreeHint = 0;
+    inodeEntry->dirReadOffset = 0;
+    inodeEntry->dirCompactDeferrals = 0;
+    inodeEntry->lruPrev = NULL;
+    inodeEntry->lruNext = NULL;
+    inodeEntry->hashPrev = NULL;
+    inodeEntry->hashNext = NULL;
+    inodeEntry->inodeInfo = &inodeEntry->inodeData;
+    memcpy(inodeEntry->inodeInfo, inodeInfo, sizeof(struct inode));
+}
+
+/**
+ * Look an inode up in the inode cache hash table, without touching the LRU list
+ * @param inodeNumber The inode number
+ * @return The inode entry, or NULL if the inode is not cached
+ */
+static InodeCacheEntry *LookupInodeInCache(int inodeNumber) {
+    for (InodeCacheEntry *inodeEntry = inodeCacheHashHead[inodeNumber % INODE_CACHESIZE]; inodeEntry; inodeEntry = inodeEntry->hashNext) {
+        if (inodeEntry->inodeNumber == inodeNumber) {
+            return inodeEntry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Move an inode entry to the tail of the LRU linked list, where the next eviction looks first
+ * @param inodeEntry The inode entry to move
+ */
+static void MoveInodeToTail(InodeCacheEntry *inodeEntry) {
+    if (inodeEntry == inodeCacheLruTail) {
+        return;
+    }
+    if (inodeEntry == inodeCacheLruHead) {
+        inodeCacheLruHead = inodeEntry->lruNext;
+        inodeCacheLruHead->lruPrev = NULL;
+    }
+    else {
+        inodeEntry->lruPrev->lruNext = inodeEntry->lruNext;
+        inodeEntry->lruNext->lruPrev = inodeEntry->lruPrev;
+    }
+    inodeEntry->lruPrev = inodeCacheLruTail;
+    inodeEntry->lruNext = NULL;
+    inodeCacheLruTail->lruNext = inodeEntry;
+    inodeCacheLruTail = inodeEntry;
+}
+
+/**
+ * Check whether a batch load may evict an inode entry: it must be clean, unpinned and without delayed blocks,
+ * so there is nothing to write back, and not batch loaded itself, so batch loads do not evict each other
+ * @param inodeEntry The inode entry
+ * @return 1 if the entry may be evicted, 0 otherwise
+ */
+static int IsSpareInodeEntry(InodeCacheEntry *inodeEntry) {
+    return !inodeEntry->isDirty && inodeEntry->pinCount == 0 && inodeEntry->delayedBlocks == 0 && !inodeEntry->batchLoaded;
+}
+
+/**
+ * Take a slot for a batch loaded inode: a free one, or else the coldest spare entry in the colder half of the
+ * LRU list, so the inodes in use stay cached
+ * @return The free slot, or NULL if there is none to spare
+ */
+static InodeCacheEntry *TakeSpareInodeCacheSlot() {
+    if (inodeCacheFreeList == NULL) {
+        InodeCacheEntry *victim = inodeCacheLruTail;
+        for (int i = 0; victim && !IsSpareInodeEntry(victim); i++) {
+            victim = (i + 1 < INODE_CACHESIZE / 2) ? victim->lruPrev : NULL;
+        }
+        if (victim == NULL || EvictInodeFromCache(victim) == ERROR) {
+            return NULL;
+        }
+    }
+    InodeCacheEntry *inodeEntry = inodeCacheFreeList;
+    inodeCacheFreeList = inodeEntry->lruNext;
+    return inodeEntry;
+}
+
+/**
+ * Load the other valid inodes of an inode block into the cache, at the cold end of the LRU list.
+ * Inodes already cached and free inodes are skipped, and loading stops once no slot can be spared
+ * @param blockEntry The inode block, already in the block cache
+ * @param blockNumber Its block number
+ * @param inodeNumber The inode the block was read for, already cached
+ */
+static void LoadInodeNeighbors(BlockCacheEntry *blockEntry, int blockNumber, int inodeNumber) {
+    PinBlock(blockEntry);
+    for (int k = 0; k < INODES_PER_BLOCK; k++) {
+        int neighbor = (blockNumber - 1) * INODES_PER_BLOCK + k;
+        struct inode *inodeInfo = (struct inode *)blockEntry->data + k;
+        if (neighbor == 0 || neighbor == inodeNumber || neighbor > fsHeader->num_inodes || inodeInfo->type == INODE_FREE ||
+            LookupInodeInCache(neighbor) != NULL) {
+            continue;
+        }
+        InodeCacheEntry *inodeEntry = TakeSpareInodeCacheSlot();
+        if (inodeEntry == NULL) {
+            break;
+        }
+        FillInodeCacheEntry(inodeEntry, neighbor, inodeInfo);
+        inodeEntry->batchLoaded = 1;
+        AddInodeToCache(inodeEntry);
+        MoveInodeToTail(inodeEntry);
+        inodeBatchLoaded += 1;
+    }
+    UnpinBlock(blockEntry);
 }
 
 /**
  * Get an inode from the cache. 
- * If the inode is not in the cache, read it from block cache and add it to the cache.
+ * If the inode is not in the cache, read it from block cache and add it to the cache,
+ * along with its neighbors in the inode block if inodeBatchLoad is set.
  * @param inodeNumber The inode number to get
  * @return The inode entry from the cache
  */
@@ -424,41 +1154,45 @@ InodeCacheEntry *GetInodeFromCache(int inodeNumber) {
     }
 
     // Find the inode in the cache first
-    int hashIndex = inodeNumber % INODE_CACHESIZE;
-    InodeCacheEntry *inodeEntry = inodeCacheHashHead[hashIndex];
-    while (inodeEntry) {
-        if (inodeEntry->inodeNumber == inodeNumber) {
-            TracePrintf(6, "GetInodeFromCache: Inode %d found in cache\n", inodeNumber);
-            MoveInodeToHead(inodeEntry);
-            return inodeEntry;
+    InodeCacheEntry *inodeEntry = LookupInodeInCache(inodeNumber);
+    if (inodeEntry) {
+        TracePrintf(6, "GetInodeFromCache: Inode %d found in cache\n", inodeNumber);
+        inodeCacheHits += 1;
+        if (inodeEntry->batchLoaded) {
+            inodeBatchHits += 1;
+            inodeEntry->batchLoaded = 0;
         }
-        inodeEntry = inodeEntry->hashNext;
+        MoveInodeToHead(inodeEntry);
+        return inodeEntry;
     }
+    inodeCacheMisses += 1;
 
     // If the inode is not in the cache, read it block cache
     TracePrintf(6, "GetInodeFromCache: Inode %d not found in cache, reading from block cache\n", inodeNumber);
+
+    // Take the slot first, since evicting a dirty inode may itself pull a block into the block cache
+    InodeCacheEntry *newInodeEntry = AllocateInodeCacheSlot();
+    if (newInodeEntry == NULL) {
+        return NULL;
+    }
     int blockNumber = inodeNumber / INODES_PER_BLOCK + 1;
     BlockCacheEntry *blockEntry = GetBlockFromCache(blockNumber);
     if (blockEntry == NULL) {
         TracePrintf(6, "GetInodeFromCache: Block number %d invalid\n", blockNumber);
+        newInodeEntry->lruNext = inodeCacheFreeList;
+        inodeCacheFreeList = newInodeEntry;
         return NULL;
     }
 
-    // Create a new inode entry
-    InodeCacheEntry *newInodeEntry = malloc(sizeof(InodeCacheEntry));
-    newInodeEntry->inodeNumber = inodeNumber;
-    newInodeEntry->isDirty = 0;
-    newInodeEntry->lruPrev = NULL;
-    newInodeEntry->lruNext = NULL;
-    newInodeEntry->hashPrev = NULL;
-    newInodeEntry->hashNext = NULL;
-    newInodeEntry->inodeInfo = malloc(sizeof(struct inode));
-    memcpy(newInodeEntry->inodeInfo, ((struct inode*)blockEntry->data) + (inodeNumber % INODES_PER_BLOCK), sizeof(struct inode));
-
+    // Fill in the recycled inode entry
+    FillInodeCacheEntry(newInodeEntry, inodeNumber, ((struct inode*)blockEntry->data) + (inodeNumber % INODES_PER_BLOCK));
     TracePrintf(6, "GetInodeFromCache: Inode %d get from block entry %d\n", inodeNumber, blockNumber);
     
     // Add the inode to the cache
     AddInodeToCache(newInodeEntry);
+    if (inodeBatchLoad) {
+        LoadInodeNeighbors(blockEntry, blockNumber, inodeNumber);
+    }
     return newInodeEntry;
 }
 
@@ -505,7 +1239,7 @@ void MarkInodeDirty(int inodeNumber) {
         if (inodeEntry->inodeNumber == inodeNumber) {
             TracePrintf(6, "MarkInodeDirty: Inode %d found in cache\n", inodeNumber);
             MoveInodeToHead(inodeEntry);
-            inodeEntry->isDirty = 1;
+            MarkInodeEntryDirty(inodeEntry);
             return;
         }
         inodeEntry = inodeEntry->hashNext;
@@ -515,6 +1249,87 @@ void MarkInodeDirty(int inodeNumber) {
 }
 
 
+/**
+ * Mark a cached inode as dirty and put it on the dirty list, without changing its position in the LRU
+ * @param inodeEntry The inode entry to mark as dirty
+ */
+void MarkInodeEntryDirty(InodeCacheEntry *inodeEntry) {
+    if (inodeEntry->isDirty) {
+        return;
+    }
+    inodeEntry->isDirty = 1;
+    inodeEntry->dirtyPrev = NULL;
+    inodeEntry->dirtyNext = inodeCacheDirtyHead;
+    if (inodeCacheDirtyHead) {
+        inodeCacheDirtyHead->dirtyPrev = inodeEntry;
+    }
+    inodeCacheDirtyHead = inodeEntry;
+    inodeCacheDirtyCount += 1;
+}
+
+/**
+ * Pin a block entry so that it is not evicted while it is being held
+ * @param blockEntry The block entry to pin
+ */
+void PinBlock(BlockCacheEntry *blockEntry) {
+    blockEntry->pinCount += 1;
+}
+
+/**
+ * Release one pin on a block entry
+ * @param blockEntry The block entry to unpin
+ */
+void UnpinBlock(BlockCacheEntry *blockEntry) {
+    if (blockEntry->pinCount > 0) {
+        blockEntry->pinCount -= 1;
+    }
+}
+
+/**
+ * Get the index of an inode entry in the inode cache pool
+ * @param inodeEntry The inode entry
+ * @return The slot index, from 0 to INODE_CACHESIZE - 1
+ */
+int GetInodeCacheSlot(InodeCacheEntry *inodeEntry) {
+    return (int)(inodeEntry - inodeCacheArena);
+}
+
+/**
+ * Pin an inode entry so that it is not evicted while it is being held
+ * @param inodeEntry The inode entry to pin
+ */
+void PinInode(InodeCacheEntry *inodeEntry) {
+    inodeEntry->pinCount += 1;
+}
+
+/**
+ * Release one pin on an inode entry
+ * @param inodeEntry The inode entry to unpin
+ */
+void UnpinInode(InodeCacheEntry *inodeEntry) {
+    if (inodeEntry->pinCount > 0) {
+        inodeEntry->pinCount -= 1;
+    }
+}
+
+/**
+ * Drop every pin still held, called once a request has been handled
+ */
+void ReleaseCachePins() {
+    for (int i = 0; i < BLOCK_CACHESIZE; i++) {
+        if (blockCacheArena.entries[i].pinCount > 0) {
+            TracePrintf(6, "ReleaseCachePins: Block %d still pinned\n", blockCacheArena.entries[i].blockNumber);
+            blockCacheArena.entries[i].pinCount = 0;
+        }
+    }
+    for (int i = 0; i < INODE_CACHESIZE; i++) {
+        if (inodeCacheArena[i].pinCount > 0) {
+            TracePrintf(6, "ReleaseCachePins: Inode %d still pinned\n", inodeCacheArena[i].inodeNumber);
+            inodeCacheArena[i].pinCount = 0;
+        }
+    }
+}
+
 /**
  * Print current block LRU cache from head to tail
  */
@@ -525,9 +1340,41 @@ void PrintBlockLRUCache() {
         TracePrintf(6, "Block #%d | Dirty: %d\n", curr->blockNumber, curr->isDirty);
         curr = curr->lruNext;
     }
+    curr = blockCacheA1inHead;
+    while (curr) {
+        TracePrintf(6, "Block #%d | Dirty: %d | A1in\n", curr->blockNumber, curr->isDirty);
+        curr = curr->lruNext;
+    }
     TracePrintf(6, "===========================\n");
 }
 
+/**
+ * Print the inode cache hit ratio and how many batch loaded inodes were used
+ */
+void PrintInodeCacheStats() {
+    long long lookups = inodeCacheHits + inodeCacheMisses;
+    TracePrintf(0, "PrintInodeCacheStats: batch loading %s, %d hits, %d misses, hit ratio %d.%02d%%\n",
+        inodeBatchLoad ? "on" : "off", inodeCacheHits, inodeCacheMisses,
+        lookups ? (int)(inodeCacheHits * 100LL / lookups) : 0, lookups ? (int)(inodeCacheHits * 10000LL / lookups % 100) : 0);
+    TracePrintf(0, "PrintInodeCacheStats: %d inodes batch loaded, %d hits, %d wasted\n",
+        inodeBatchLoaded, inodeBatchHits, inodeBatchWasted);
+}
+
+/**
+ * Print the block cache hit ratio
+ */
+void PrintBlockCacheStats() {
+    long long lookups = blockCacheHits + blockCacheMisses;
+    TracePrintf(0, "PrintBlockCacheStats: policy %s, %d hits, %d misses, hit ratio %d.%02d%%\n",
+        (blockCachePolicy == CACHE_POLICY_2Q) ? "2Q" : "LRU", blockCacheHits, blockCacheMisses,
+        lookups ? (int)(blockCacheHits * 100LL / lookups) : 0, lookups ? (int)(blockCacheHits * 10000LL / lookups % 100) : 0);
+    TracePrintf(0, "PrintBlockCacheStats: %d blocks set up for overwrite without a disk read\n", blockCacheOverwrites);
+    TracePrintf(0, "PrintBlockCacheStats: read-ahead %d blocks, %d hits, %d wasted\n",
+        readAheadIssued, readAheadHits, readAheadWasted);
+    TracePrintf(0, "PrintBlockCacheStats: disk %d reads, %d writes, total seek distance %d sectors\n",
+        diskReads, diskWrites, diskSeekDistance);
+}
+
 /**
  * Print block cache hash table
  */
@@ -10,15 +10,39 @@ extern void InitializeCache();
 extern void SyncCache();
 
 /**
- * Block cache
+ * Block cache replacement policies, selected at build time with -DBLOCK_CACHE_POLICY
+ * CACHE_POLICY_LRU: a single LRU list
+ * CACHE_POLICY_2Q: scan-resistant 2Q, first references go through a small FIFO (A1in) and only
+ *                  blocks referenced again after leaving it (found in the A1out ghost list) enter the LRU list (Am)
  */
-extern int *freeBlocksList;         // An array to keep track of free blocks, 1 for free, 0 for used
-extern int freeBlocksCount;         // Number of free blocks available
+#define CACHE_POLICY_LRU 0
+#define CACHE_POLICY_2Q 1
+
+#ifndef BLOCK_CACHE_POLICY
+#define BLOCK_CACHE_POLICY CACHE_POLICY_LRU
+#endif
+
+#define BLOCK_QUEUE_AM 0                            // Block is in the main LRU list
+#define BLOCK_QUEUE_A1IN 1                          // Block is in the 2Q first-reference FIFO
+
+#define BLOCK_CACHE_A1IN_SIZE (BLOCK_CACHESIZE / 4)  // Kin, the A1in share of the cache
+#define BLOCK_CACHE_A1OUT_SIZE (BLOCK_CACHESIZE * 4) // Kout, A1out only holds block numbers so it can span several cache-fulls
 
+extern int blockCachePolicy;
+
+/**
+ * Block cache
+ */
 typedef struct BlockCacheEntry {
     int blockNumber;
     int isDirty;
-    void* data;
+    void* data;                                 // Points into the preallocated block data arena
+    int queue;                                  // BLOCK_QUEUE_AM or BLOCK_QUEUE_A1IN
+    int prefetched;                             // Loaded by read-ahead and not referenced since
+    int pinCount;                               // Number of holders, a pinned entry is never evicted
+    int delayed;                                // Holds a file block with no disk block yet, never evicted or written
+    struct BlockCacheEntry *dirtyPrev;          // Links in the dirty list while isDirty is set
+    struct BlockCacheEntry *dirtyNext;
     struct BlockCacheEntry *lruPrev;
     struct BlockCacheEntry *lruNext;
     struct BlockCacheEntry *hashPrev;
@@ -30,26 +54,99 @@ extern BlockCacheEntry *blockCacheLruHead;      // The head of the list is the M
 extern BlockCacheEntry *blockCacheLruTail;      // The tail of the list is the LEAST recently used
 extern int blockCacheCount;
 
+// 2Q FIFO for blocks referenced only once, linked through lruPrev/lruNext (empty under LRU)
+extern BlockCacheEntry *blockCacheA1inHead;     // The head of the list is the newest block
+extern BlockCacheEntry *blockCacheA1inTail;     // The tail of the list is the oldest block
+extern int blockCacheA1inCount;
+
+// Dirty blocks, so that a sync only visits entries that need writing back.
+// Never set isDirty directly, use MarkBlockDirty or MarkBlockEntryDirty
+extern BlockCacheEntry *blockCacheDirtyHead;
+extern int blockCacheDirtyCount;
+
+// Hit ratio counters
+extern int blockCacheHits;
+extern int blockCacheMisses;
+extern int blockCacheOverwrites;                // Misses served by GetBlockForOverwrite without reading disk
+
+// Read-ahead: the window grows from MIN to MAX blocks while an inode keeps being read sequentially
+#define READ_AHEAD_MIN_WINDOW 2
+#define READ_AHEAD_MAX_WINDOW (BLOCK_CACHESIZE / 4)
+
+// Read-ahead counters: prefetched blocks later referenced (hits) or evicted unreferenced (wasted)
+extern int readAheadIssued;
+extern int readAheadHits;
+extern int readAheadWasted;
+
+// Disk access counters, printed by PrintBlockCacheStats
+extern int diskReads;
+extern int diskWrites;
+extern int diskSeekDistance;
+
 // Hash table for block cache
 extern BlockCacheEntry *blockCacheHashHead[BLOCK_CACHESIZE];
 extern BlockCacheEntry *blockCacheHashTail[BLOCK_CACHESIZE];
 
+// Preallocated pool of block cache entries, unused slots are chained through lruNext
+extern BlockCacheEntry *blockCacheFreeList;
+
+/**
+ * Delayed allocation: data appended to a file is cached under a key made of the inode cache slot of the file and
+ * the logical block instead of a disk block number, and only gets a disk block when the file's delayed blocks are
+ * allocated together (fs/blockmap.c). An inode with delayed blocks has them allocated before it leaves its slot.
+ * GetBlockFromCache and GetBlockForOverwrite accept such a key and never go to disk for it
+ */
+#define DELAYED_BLOCK_FLAG 0x40000000
+#define DELAYED_BLOCK_KEY(inodeSlot, logicalBlock) (DELAYED_BLOCK_FLAG | ((inodeSlot) << 22) | (logicalBlock))
+
+// The slot takes bits 22 to 29 of a key and the logical block the 22 bits below, neither may reach the flag
+#if INODE_CACHESIZE > 256
+#error "DELAYED_BLOCK_KEY holds the inode cache slot in 8 bits, INODE_CACHESIZE must be at most 256"
+#endif
+typedef char DelayedBlockKeyFitsLogicalBlock[(MAX_FILE_SIZE / BLOCKSIZE < (1 << 22)) ? 1 : -1];
+
 void AddBlockToCache(BlockCacheEntry* blockEntry);
 void EvictBlockFromCache(BlockCacheEntry* blockEntry);
 BlockCacheEntry* GetBlockFromCache(int blockNumber);
+BlockCacheEntry* GetBlockForOverwrite(int blockNumber);
+void PrefetchBlock(int blockNumber);
+BlockCacheEntry* CreateDelayedBlock(int key);
+int AssignDelayedBlock(BlockCacheEntry* blockEntry, int blockNumber);
+void DropDelayedBlock(int key);
+void PinBlock(BlockCacheEntry* blockEntry);
+void UnpinBlock(BlockCacheEntry* blockEntry);
 void MoveBlockToHead(BlockCacheEntry* blockEntry);
 void MarkBlockDirty(int blockNumber);
+void MarkBlockEntryDirty(BlockCacheEntry* blockEntry);
+void PrintBlockCacheStats();
 
 /**
  * Inode cache
  */
-extern int *freeInodesList;         // An array to keep track of free inodes, 1 for free, 0 for used
-extern int freeInodesCount;         // Number of free inodes available
-
 typedef struct InodeCacheEntry {
     int inodeNumber;
     int isDirty;
-    struct inode *inodeInfo;
+    struct inode *inodeInfo;                    // Points to inodeData below
+    struct inode inodeData;                     // The inode is stored inline in the entry
+    int pinCount;                               // Number of holders, a pinned entry is never evicted
+    int batchLoaded;                            // Loaded along with a neighbor on a miss and not referenced since
+    int blockMapReuse;                          // Reuse count the four fields below were computed for
+    int blockCursor;                            // No logical block from here on is allocated, -1 until counted
+    int *blockMap;                              // Disk block numbers of logical blocks 0 to MAPPED_FILE_BLOCKS - 1, 0 for holes, allocated on first use
+    int blockMapValid;                          // Set while blockMap matches the inode and its indirect block
+    int treeRoots[2];                           // Regular files: roots of the double and triple indirect trees, -1 until read from the root table
+    int allocReserveNext;                       // Blocks [allocReserveNext, allocReserveEnd) are held back for the file to grow into,
+    int allocReserveEnd;                        // they are marked used in the free map but not part of the file yet
+    int delayedStart;                           // First logical block of the delayed run, at or past blockCursor
+    int delayedBlocks;                          // Logical blocks delayedStart onwards that only exist as delayed cache blocks
+    int delayedPromise;                         // Free blocks promised to them, counted in freeBlocksPromised
+    int dirMetaReuse;                           // Directories: reuse count the two fields below were computed for
+    int dirEntryCount;                          // Directories: live entries other than "." and "..", -1 until scanned
+    int dirFreeHint;                            // Directories: every entry below this slot is in use
+    int dirReadOffset;                          // Directories: where a client listing stopped, 0 when none is in progress
+    int dirCompactDeferrals;                    // Directories: compactions put off for that listing
+    struct InodeCacheEntry *dirtyPrev;          // Links in the dirty list while isDirty is set
+    struct InodeCacheEntry *dirtyNext;
     struct InodeCacheEntry *lruPrev;
     struct InodeCacheEntry *lruNext;
     struct InodeCacheEntry *hashPrev;
@@ -61,15 +158,53 @@ extern InodeCacheEntry *inodeCacheLruHead;      // The head of the list is the M
 extern InodeCacheEntry *inodeCacheLruTail;      // The tail of the list is the LEAST recently used
 extern int inodeCacheCount;
 
+// Dirty inodes, never set isDirty directly, use MarkInodeDirty or MarkInodeEntryDirty
+extern InodeCacheEntry *inodeCacheDirtyHead;
+extern int inodeCacheDirtyCount;
+
 // Hash table for inode cache
 extern InodeCacheEntry *inodeCacheHashHead[INODE_CACHESIZE];
 extern InodeCacheEntry *inodeCacheHashTail[INODE_CACHESIZE];
 
+// Preallocated pool of inode cache entries, unused slots are chained through lruNext
+extern InodeCacheEntry *inodeCacheFreeList;
+
+/**
+ * Inode batch loading, selected at build time with -DINODE_BATCH_LOAD: on a miss, the other valid inodes of the
+ * same inode block are loaded too, at the cold end of the LRU list. They only take free slots or recycle clean,
+ * unpinned entries from the colder half of the list, so the inodes in use stay cached
+ */
+#ifndef INODE_BATCH_LOAD
+#define INODE_BATCH_LOAD 1
+#endif
+
+extern int inodeBatchLoad;
+
+// Inode cache counters: lookups, and batch loaded inodes later referenced (hits) or evicted unreferenced (wasted)
+extern int inodeCacheHits;
+extern int inodeCacheMisses;
+extern int inodeBatchLoaded;
+extern int inodeBatchHits;
+extern int inodeBatchWasted;
+
 void AddInodeToCache(InodeCacheEntry *inodeEntry);
-void EvictInodeFromCache(InodeCacheEntry* inodeEntry);
+int EvictInodeFromCache(InodeCacheEntry* inodeEntry);
 InodeCacheEntry* GetInodeFromCache(int inodeNumber);
 void MoveInodeToHead(InodeCacheEntry* inodeEntry);
 void MarkInodeDirty(int inodeNumber);
+void MarkInodeEntryDirty(InodeCacheEntry* inodeEntry);
+int GetInodeCacheSlot(InodeCacheEntry* inodeEntry);
+void PinInode(InodeCacheEntry* inodeEntry);
+void UnpinInode(InodeCacheEntry* inodeEntry);
+void PrintInodeCacheStats();
+
+/**
+ * Pinning: a handler that keeps a cache entry pointer across further GetBlockFromCache / GetInodeFromCache
+ * calls pins the entry so that it cannot be evicted underneath it. Eviction skips pinned entries, and a
+ * lookup that finds every entry pinned fails with NULL. ReleaseCachePins drops whatever is still pinned
+ * at the end of a request, so an early error return cannot leak a pin.
+ */
+void ReleaseCachePins();
 
 void PrintBlockLRUCache();
 void PrintBlockHashTable();
@@ -0,0 +1,1038 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blockmap.h"
+#include "freemap.h"
+
+// Counters printed by PrintBlockMapStats
+int blockMapLoads = 0;                  // Block maps decoded from an indirect block
+int fileBlocksAllocated = 0;            // Data blocks allocated by MapBlockRange
+int fileBlocksContiguous = 0;           // Of those, blocks right after the previous block of their file
+int delayedBlocksCached = 0;            // Delayed blocks waiting for a disk block, over all files
+int delayedBlocksAllocated = 0;         // Delayed blocks that got their disk block
+int delayedAllocations = 0;             // Times the delayed blocks of a file were allocated
+int inlineFilesStored = 0;              // Files and symbolic links whose data went inline
+int inlineFilesMoved = 0;               // Inline files that outgrew the inode and moved to a block
+
+/**
+ * Number of free blocks the delayed blocks of a file need: one per block, the indirect block if they reach
+ * past the direct blocks of a file that has none yet, and for every leaf of the double or triple indirect
+ * trees they reach into, up to three indirect blocks (leaf, inner block and root) in case those are missing
+ * @param inodeEntry The inode cache entry of the file
+ * @return The number of blocks to promise
+ */
+static int DelayedBlocksPromise(struct InodeCacheEntry *inodeEntry) {
+    int delayed = inodeEntry->delayedBlocks;
+    if (delayed == 0) {
+        return 0;
+    }
+    int promise = delayed;
+    int end = inodeEntry->delayedStart + delayed;
+    if (inodeEntry->inodeInfo->indirect == 0 && end > NUM_DIRECT) {
+        promise++;
+    }
+    if (end > MAPPED_FILE_BLOCKS) {
+        int treeStart = (inodeEntry->delayedStart > MAPPED_FILE_BLOCKS) ? inodeEntry->delayedStart : MAPPED_FILE_BLOCKS;
+        promise += 3 * ((end - treeStart + INDIRECT_BLOCK_NUMS - 1) / INDIRECT_BLOCK_NUMS + 1);
+    }
+    return promise;
+}
+
+/**
+ * Bring the free blocks promised to the delayed blocks of a file in line with how many it has now
+ * @param inodeEntry The inode cache entry of the file
+ */
+static void UpdateDelayedPromise(struct InodeCacheEntry *inodeEntry) {
+    freeBlocksPromised -= inodeEntry->delayedPromise;
+    inodeEntry->delayedPromise = DelayedBlocksPromise(inodeEntry);
+    freeBlocksPromised += inodeEntry->delayedPromise;
+}
+
+/**
+ * Throw away the delayed blocks of a file past the first keepDelayed ones, and the free blocks promised to them
+ * @param inodeEntry The inode cache entry of the file
+ * @param keepDelayed The number of delayed blocks to keep
+ */
+static void DropDelayedBlocks(struct InodeCacheEntry *inodeEntry, int keepDelayed) {
+    if (inodeEntry->delayedBlocks <= keepDelayed) {
+        return;
+    }
+    int slot = GetInodeCacheSlot(inodeEntry);
+    for (int i = keepDelayed; i < inodeEntry->delayedBlocks; i++) {
+        DropDelayedBlock(DELAYED_BLOCK_KEY(slot, inodeEntry->delayedStart + i));
+    }
+    delayedBlocksCached -= inodeEntry->delayedBlocks - keepDelayed;
+    inodeEntry->delayedBlocks = keepDelayed;
+    UpdateDelayedPromise(inodeEntry);
+}
+
+/**
+ * Drop the allocation cursor, the block map, the tree roots, the reserved and the delayed blocks of an inode cache entry
+ * if they belong to an earlier reuse count
+ * @param inodeEntry The inode cache entry of the file
+ */
+static void CheckBlockMapReuse(struct InodeCacheEntry *inodeEntry) {
+    if (inodeEntry->blockMapReuse != inodeEntry->inodeInfo->reuse) {
+        DropDelayedBlocks(inodeEntry, 0);
+        ReleaseBlockReservation(inodeEntry);
+        inodeEntry->blockMapReuse = inodeEntry->inodeInfo->reuse;
+        inodeEntry->blockCursor = -1;
+        inodeEntry->blockMapValid = 0;
+        inodeEntry->treeRoots[0] = -1;
+        inodeEntry->treeRoots[1] = -1;
+    }
+}
+
+/**
+ * Decode the disk block numbers of the first count logical blocks of a file, holes decode as 0
+ * @param inodeInfo The inode of the file
+ * @param indirectBlockNums The contents of its indirect block, or NULL if count is at most NUM_DIRECT
+ * @param blocks Filled with the count disk block numbers
+ * @param count The number of logical blocks to decode, at most MAPPED_FILE_BLOCKS
+ */
+void DecodeBlockMap(struct inode *inodeInfo, int *indirectBlockNums, int *blocks, int count) {
+    for (int i = 0; i < count; i++) {
+        blocks[i] = (i < NUM_DIRECT) ? inodeInfo->direct[i] : indirectBlockNums[i - NUM_DIRECT];
+    }
+}
+
+/**
+ * Decode the block map of a file that uses its indirect block, reading the indirect block once.
+ * The map array stays with the inode cache slot and is reused by the next inode loaded into it
+ * @param inodeEntry The inode cache entry of the file
+ * @return The block map, holding MAPPED_FILE_BLOCKS entries, or NULL if it cannot be built
+ */
+static int *LoadBlockMap(struct InodeCacheEntry *inodeEntry) {
+    struct inode *inodeInfo = inodeEntry->inodeInfo;
+    CheckBlockMapReuse(inodeEntry);
+    if (inodeEntry->blockMapValid) {
+        return inodeEntry->blockMap;
+    }
+    if (inodeEntry->blockMap == NULL) {
+        inodeEntry->blockMap = malloc(sizeof(int) * MAPPED_FILE_BLOCKS);
+        if (inodeEntry->blockMap == NULL) {
+            TracePrintf(0, "LoadBlockMap: Out of memory for the block map of inode %d\n", inodeEntry->inodeNumber);
+            return NULL;
+        }
+    }
+
+    // Without an indirect block the entries past the direct blocks are all holes
+    if (inodeInfo->indirect > 0) {
+        struct BlockCacheEntry *indirectEntry = GetBlockFromCache(inodeInfo->indirect);
+        if (indirectEntry == NULL) {
+            return NULL;
+        }
+        DecodeBlockMap(inodeInfo, (int *)indirectEntry->data, inodeEntry->blockMap, MAPPED_FILE_BLOCKS);
+    }
+    else {
+        DecodeBlockMap(inodeInfo, NULL, inodeEntry->blockMap, NUM_DIRECT);
+        memset(inodeEntry->blockMap + NUM_DIRECT, 0, sizeof(int) * INDIRECT_BLOCK_NUMS);
+    }
+    blockMapLoads++;
+    TracePrintf(0, "LoadBlockMap: Decoded the block map of inode %d\n", inodeEntry->inodeNumber);
+    inodeEntry->blockMapValid = 1;
+    return inodeEntry->blockMap;
+}
+
+/**
+ * Get the block of the inode root table that holds the roots of an inode
+ * @param inodeNumber The inode
+ * @param create If set, reserve the table if the file system has none yet
+ * @return The table block, or NULL if there is no table and none could be reserved
+ */
+static struct BlockCacheEntry *GetRootTableBlock(int inodeNumber, int create) {
+    struct fs_mount_header *mountHeader = (struct fs_mount_header *)fsHeader;
+    if (mountHeader->magic != FS_CHECKPOINT_MAGIC || mountHeader->rootTableBlocks == 0) {
+        if (!create || ReserveRootTable() == ERROR) {
+            return NULL;
+        }
+    }
+    return GetBlockFromCache(mountHeader->rootTableStart + inodeNumber / ROOTS_PER_BLOCK);
+}
+
+/**
+ * Get the roots of the double and triple indirect trees of a file. They are read from the root table once
+ * and kept in the inode cache entry, so walking a large file does not go back to the table for every leaf
+ * @param inodeEntry The inode cache entry of the file
+ * @return The two roots, 0 for a tree the file does not have, or NULL if the table block cannot be read
+ */
+static int *GetTreeRoots(struct InodeCacheEntry *inodeEntry) {
+    CheckBlockMapReuse(inodeEntry);
+    if (inodeEntry->treeRoots[0] >= 0) {
+        return inodeEntry->treeRoots;
+    }
+    struct fs_mount_header *mountHeader = (struct fs_mount_header *)fsHeader;
+    inodeEntry->treeRoots[0] = 0;
+    inodeEntry->treeRoots[1] = 0;
+    // Directories never grow past the block map, and without a table no file has a tree
+    if (inodeEntry->inodeInfo->type == INODE_REGULAR && mountHeader->magic == FS_CHECKPOINT_MAGIC && mountHeader->rootTableBlocks > 0) {
+        struct BlockCacheEntry *tableEntry = GetRootTableBlock(inodeEntry->inodeNumber, 0);
+        if (tableEntry == NULL) {
+            inodeEntry->treeRoots[0] = -1;
+            inodeEntry->treeRoots[1] = -1;
+            return NULL;
+        }
+        struct inode_roots *roots = (struct inode_roots *)tableEntry->data + inodeEntry->inodeNumber % ROOTS_PER_BLOCK;
+        inodeEntry->treeRoots[0] = roots->doubleIndirect;
+        inodeEntry->treeRoots[1] = roots->tripleIndirect;
+    }
+    return inodeEntry->treeRoots;
+}
+
+/**
+ * Set the root of the double or triple indirect tree of a file, in the inode cache entry and in the root table
+ * @param inodeEntry The inode cache entry of the file
+ * @param depth 2 for the double and 3 for the triple indirect tree
+ * @param blockNum The new root, 0 for none
+ * @return 0 on success, ERROR if the root table is missing or cannot be read
+ */
+static int SetTreeRoot(struct InodeCacheEntry *inodeEntry, int depth, int blockNum) {
+    struct BlockCacheEntry *tableEntry = GetRootTableBlock(inodeEntry->inodeNumber, 0);
+    if (tableEntry == NULL) {
+        return ERROR;
+    }
+    struct inode_roots *roots = (struct inode_roots *)tableEntry->data + inodeEntry->inodeNumber % ROOTS_PER_BLOCK;
+    if (depth == 2) {
+        roots->doubleIndirect = blockNum;
+    }
+    else {
+        roots->tripleIndirect = blockNum;
+    }
+    inodeEntry->treeRoots[depth - 2] = blockNum;
+    MarkBlockEntryDirty(tableEntry);
+    return 0;
+}
+
+/**
+ * Find the tree that holds a logical block past the block map
+ * @param logicalBlock A logical block at or past MAPPED_FILE_BLOCKS
+ * @param index Set to the index of the block within its tree
+ * @return The depth of the tree, 2 for the double and 3 for the triple indirect tree
+ */
+static int GetTreeOf(int logicalBlock, int *index) {
+    *index = logicalBlock - MAPPED_FILE_BLOCKS;
+    if (*index < DOUBLE_INDIRECT_BLOCKS) {
+        return 2;
+    }
+    *index -= DOUBLE_INDIRECT_BLOCKS;
+    return 3;
+}
+
+/**
+ * Allocate a zeroed block for the double or triple indirect tree of a file. Unlike the single indirect block,
+ * a tree block goes in line with the data, right after the data block before it, so reading a large file
+ * front to back does not seek back to its indirect blocks once every INDIRECT_BLOCK_NUMS blocks
+ * @param inodeEntry The inode cache entry of the file
+ * @param lastBlock The disk block the new block should follow, or 0 to take any free block
+ * @return The block number, or ERROR if no free blocks are available
+ */
+static int AllocateTreeBlock(struct InodeCacheEntry *inodeEntry, int lastBlock) {
+    if (lastBlock <= 0) {
+        return AllocateBlock();
+    }
+    // The reserved run of the file continues after the tree block, the data after it takes the rest
+    if (inodeEntry->allocReserveNext == lastBlock + 1 && inodeEntry->allocReserveNext < inodeEntry->allocReserveEnd) {
+        return ClaimBlock(inodeEntry->allocReserveNext++);
+    }
+    if (freeBlocksCount - freeBlocksPromised <= 0) {
+        ReleaseAllBlockReservations();
+    }
+    if (freeBlocksCount - freeBlocksPromised <= 0) {
+        return ERROR;
+    }
+    int blockNum = FindFreeBlockNear(lastBlock + 1, 1);
+    return (blockNum == ERROR) ? ERROR : ClaimBlock(blockNum);
+}
+
+/**
+ * Get the leaf of the double or triple indirect tree that holds a logical block, the indirect block whose
+ * entries are data block numbers. The leaves cover INDIRECT_BLOCK_NUMS blocks each, aligned on MAPPED_FILE_BLOCKS
+ * @param inodeEntry The inode cache entry of the file
+ * @param logicalBlock A logical block at or past MAPPED_FILE_BLOCKS
+ * @param lastBlock NULL to only look the leaf up. Otherwise the root table, the root and the inner indirect blocks
+ *                  on the way are allocated if they do not exist yet, zeroed like any indirect block and in line
+ *                  after the disk block *lastBlock, which is moved to the last block allocated
+ * @return The leaf block number, 0 if the block lies in a hole without a leaf, or ERROR
+ */
+static int GetTreeLeaf(struct InodeCacheEntry *inodeEntry, int logicalBlock, int *lastBlock) {
+    int create = (lastBlock != NULL);
+    int index;
+    int depth = GetTreeOf(logicalBlock, &index);
+    int *roots = GetTreeRoots(inodeEntry);
+    if (roots == NULL) {
+        return ERROR;
+    }
+    if (roots[depth - 2] == 0) {
+        if (!create) {
+            return 0;
+        }
+        if (GetRootTableBlock(inodeEntry->inodeNumber, 1) == NULL) {
+            return ERROR;
+        }
+        int blockNum = AllocateTreeBlock(inodeEntry, *lastBlock);
+        if (blockNum == ERROR) {
+            return ERROR;
+        }
+        if (SetTreeRoot(inodeEntry, depth, blockNum) == ERROR) {
+            FreeBlock(blockNum);
+            return ERROR;
+        }
+        *lastBlock = blockNum;
+    }
+
+    int blockNum = roots[depth - 2];
+    for (int span = (depth == 3) ? DOUBLE_INDIRECT_BLOCKS : INDIRECT_BLOCK_NUMS; span > 1; span /= INDIRECT_BLOCK_NUMS) {
+        struct BlockCacheEntry *indirectEntry = GetBlockFromCache(blockNum);
+        if (indirectEntry == NULL) {
+            return ERROR;
+        }
+        int *child = (int *)indirectEntry->data + (index / span) % INDIRECT_BLOCK_NUMS;
+        if (*child == 0) {
+            if (!create) {
+                return 0;
+            }
+            PinBlock(indirectEntry);
+            int childNum = AllocateTreeBlock(inodeEntry, *lastBlock);
+            UnpinBlock(indirectEntry);
+            if (childNum == ERROR) {
+                return ERROR;
+            }
+            *child = childNum;
+            *lastBlock = childNum;
+            MarkBlockEntryDirty(indirectEntry);
+        }
+        blockNum = *child;
+    }
+    return blockNum;
+}
+
+/**
+ * Find the logical block right after the last data block of an indirect tree, or of one of its subtrees
+ * @param blockNum The indirect block at the top of the (sub)tree
+ * @param depth 1 for a leaf, up to 3 for the root of the triple indirect tree
+ * @param base The logical block of the first entry under blockNum
+ * @return The logical block after its last data block, 0 if it has none, or ERROR
+ */
+static int GetTreeEnd(int blockNum, int depth, int base) {
+    struct BlockCacheEntry *indirectEntry = GetBlockFromCache(blockNum);
+    if (indirectEntry == NULL) {
+        return ERROR;
+    }
+    int span = (depth == 3) ? DOUBLE_INDIRECT_BLOCKS : (depth == 2) ? INDIRECT_BLOCK_NUMS : 1;
+    int end = 0;
+    // Reading the subtrees goes through the cache, keep this block from being evicted meanwhile
+    PinBlock(indirectEntry);
+    for (int k = INDIRECT_BLOCK_NUMS - 1; k >= 0 && end == 0; k--) {
+        int child = ((int *)indirectEntry->data)[k];
+        if (child != 0) {
+            end = (depth == 1) ? base + k + 1 : GetTreeEnd(child, depth - 1, base + k * span);
+        }
+    }
+    UnpinBlock(indirectEntry);
+    return end;
+}
+
+/**
+ * Get the logical block right after the last allocated one of a file, where appending continues.
+ * Every block from the cursor on is unallocated, the ones before it may still be holes.
+ * The cursor is found once, after that MapBlockRange and ShrinkFile keep it, and a new reuse count drops it.
+ * The last data block of a regular file is looked for in its triple, then its double indirect tree, and
+ * otherwise in the block map, which is decoded along the way for a file with an indirect block
+ * @param inodeEntry The inode cache entry of the file
+ * @return The allocation cursor, or ERROR if the indirect block cannot be read
+ */
+int GetAllocationCursor(struct InodeCacheEntry *inodeEntry) {
+    struct inode *inodeInfo = inodeEntry->inodeInfo;
+    CheckBlockMapReuse(inodeEntry);
+    if (inodeEntry->blockCursor >= 0) {
+        return inodeEntry->blockCursor;
+    }
+    // The direct block numbers of an inline file are its data
+    if (HasInlineData(inodeInfo)) {
+        inodeEntry->blockCursor = 0;
+        return 0;
+    }
+
+    int cursor = 0;
+    int *roots = GetTreeRoots(inodeEntry);
+    if (roots == NULL) {
+        return ERROR;
+    }
+    if (roots[1] != 0) {
+        cursor = GetTreeEnd(roots[1], 3, MAPPED_FILE_BLOCKS + DOUBLE_INDIRECT_BLOCKS);
+    }
+    if (cursor == 0 && roots[0] != 0) {
+        cursor = GetTreeEnd(roots[0], 2, MAPPED_FILE_BLOCKS);
+    }
+    if (cursor == ERROR) {
+        return ERROR;
+    }
+    if (cursor == 0) {
+        int *blockMap = inodeInfo->direct;
+        cursor = NUM_DIRECT;
+        if (inodeInfo->indirect > 0) {
+            blockMap = LoadBlockMap(inodeEntry);
+            if (blockMap == NULL) {
+                return ERROR;
+            }
+            cursor = MAPPED_FILE_BLOCKS;
+        }
+        while (cursor > 0 && blockMap[cursor - 1] == 0) {
+            cursor--;
+        }
+    }
+    TracePrintf(0, "GetAllocationCursor: Inode %d has %d data blocks\n", inodeEntry->inodeNumber, cursor);
+    inodeEntry->blockCursor = cursor;
+    return cursor;
+}
+
+/**
+ * Return the blocks reserved for a file to the free map
+ * @param inodeEntry The inode cache entry of the file
+ */
+void ReleaseBlockReservation(struct InodeCacheEntry *inodeEntry) {
+    for (int i = inodeEntry->allocReserveNext; i < inodeEntry->allocReserveEnd; i++) {
+        FreeBlock(i);
+    }
+    inodeEntry->allocReserveNext = 0;
+    inodeEntry->allocReserveEnd = 0;
+}
+
+/**
+ * Return the blocks reserved for every cached file to the free map, when the disk runs out of free blocks
+ * and before the free map is checkpointed
+ */
+void ReleaseAllBlockReservations() {
+    for (struct InodeCacheEntry *inodeEntry = inodeCacheLruHead; inodeEntry != NULL; inodeEntry = inodeEntry->lruNext) {
+        ReleaseBlockReservation(inodeEntry);
+    }
+}
+
+/**
+ * Allocate the data block for logical block cursor of a file, next to the disk block of the logical block before it.
+ * A regular file takes its reserved blocks first. If it has none left, or they are not where the file continues,
+ * it gets the next disk block if that is free, or else the start of a free run long enough for the blocks still
+ * to come, and reserves the free blocks after it
+ * @param inodeEntry The inode cache entry of the file
+ * @param lastBlock The disk block of logical block cursor - 1, or 0 for the first block or after a hole
+ * @param cursor The logical block being allocated
+ * @param remaining The number of blocks the caller is allocating from cursor on
+ * @param adoptDelayed If set, the block takes over the data of the delayed block for cursor instead of being zeroed
+ * @return The block, or ERROR if no free blocks are available
+ */
+static int AllocateFileBlock(struct InodeCacheEntry *inodeEntry, int lastBlock, int cursor, int remaining, int adoptDelayed) {
+    int goal = (lastBlock > 0) ? lastBlock + 1 : 0;
+    if (inodeEntry->allocReserveNext != goal) {
+        ReleaseBlockReservation(inodeEntry);
+    }
+
+    int blockNum;
+    if (inodeEntry->allocReserveNext < inodeEntry->allocReserveEnd) {
+        blockNum = inodeEntry->allocReserveNext++;
+    }
+    else {
+        int runLength = 1;
+        if (inodeEntry->inodeInfo->type == INODE_REGULAR) {
+            runLength = (cursor < ALLOC_RESERVE_MIN) ? ALLOC_RESERVE_MIN : (cursor > ALLOC_RESERVE_MAX) ? ALLOC_RESERVE_MAX : cursor;
+            if (runLength < remaining) {
+                runLength = remaining;
+            }
+        }
+        // Blocks promised to delayed allocations are not free for anyone else, reserved runs go first
+        if (freeBlocksCount - freeBlocksPromised <= 0) {
+            ReleaseAllBlockReservations();
+        }
+        if (freeBlocksCount - freeBlocksPromised <= 0) {
+            return ERROR;
+        }
+        blockNum = FindFreeBlockNear(goal, runLength);
+        if (blockNum == ERROR) {
+            return ERROR;
+        }
+        MarkBlockUsed(blockNum);
+        if (runLength > freeBlocksCount - freeBlocksPromised + 1) {
+            runLength = freeBlocksCount - freeBlocksPromised + 1;
+        }
+        inodeEntry->allocReserveNext = blockNum + 1;
+        inodeEntry->allocReserveEnd = blockNum + 1 + TakeFreeRun(blockNum + 1, runLength - 1);
+    }
+    fileBlocksAllocated++;
+    if (blockNum == goal) {
+        fileBlocksContiguous++;
+    }
+    if (adoptDelayed) {
+        struct BlockCacheEntry *blockEntry = GetBlockFromCache(DELAYED_BLOCK_KEY(GetInodeCacheSlot(inodeEntry), cursor));
+        if (blockEntry != NULL && AssignDelayedBlock(blockEntry, blockNum) == 0) {
+            return blockNum;
+        }
+        TracePrintf(0, "AllocateFileBlock: Delayed block %d of inode %d is missing\n", cursor, inodeEntry->inodeNumber);
+    }
+    return ClaimBlock(blockNum);
+}
+
+/**
+ * Map the logical blocks [start, end) of a file to disk blocks in one pass.
+ * Blocks up to MAPPED_FILE_BLOCKS come from the decoded block map, so the indirect block is only read to build it,
+ * blocks past it from the leaves of the double and triple indirect trees, one leaf lookup per INDIRECT_BLOCK_NUMS blocks.
+ * Delayed blocks map to their DELAYED_BLOCK_KEY, which the block cache accepts like a block number, and holes
+ * map to 0. With MAP_ALLOCATE, the holes in the range are allocated first, zeroed and in order, and the blocks
+ * between the range and the rest of the file stay holes
+ * @param inodeEntry The inode cache entry of the file
+ * @param start The first logical block
+ * @param end One past the last logical block
+ * @param blocks Filled with the end - start disk block numbers, or NULL to only allocate
+ * @param allocate MAP_RESOLVE, MAP_ALLOCATE or MAP_ALLOCATE_DELAYED
+ * @return 0 on success, ERROR on failure (the blocks allocated until then stay allocated), or for a file
+ *         with inline data, which has no blocks to map
+ */
+int MapBlockRange(struct InodeCacheEntry *inodeEntry, int start, int end, int *blocks, int allocate) {
+    struct inode *inodeInfo = inodeEntry->inodeInfo;
+    if (start < 0 || start > end || end > MAX_FILE_BLOCKS || HasInlineData(inodeInfo)) {
+        return ERROR;
+    }
+    CheckBlockMapReuse(inodeEntry);
+    int status = 0;
+
+    if (allocate != MAP_RESOLVE) {
+        // The delayed run must stay past the cursor, and its blocks keep their data, so it is allocated first
+        // if the range reaches it
+        if (allocate == MAP_ALLOCATE && inodeEntry->delayedBlocks > 0 && end > inodeEntry->delayedStart &&
+            AllocateDelayedBlocks(inodeEntry) == ERROR) {
+            return ERROR;
+        }
+        int cursor = GetAllocationCursor(inodeEntry);
+        if (cursor == ERROR) {
+            return ERROR;
+        }
+        int adoptDelayed = (allocate == MAP_ALLOCATE_DELAYED);
+        TracePrintf(0, "MapBlockRange: Allocating the holes in blocks %d to %d of inode %d\n", start, end - 1, inodeEntry->inodeNumber);
+        // A decoded map is kept up to date as blocks are allocated
+        int *blockMap = inodeEntry->blockMapValid ? inodeEntry->blockMap : NULL;
+        int newCursor = cursor;
+        int i = start;
+        int lastBlock = 0;
+        if (i > 0 && i <= NUM_DIRECT) {
+            lastBlock = inodeInfo->direct[i - 1];
+        }
+        else if (i > NUM_DIRECT && i <= MAPPED_FILE_BLOCKS && blockMap != NULL) {
+            lastBlock = blockMap[i - 1];
+        }
+        for (; i < end && i < NUM_DIRECT; i++) {
+            if (inodeInfo->direct[i] == 0) {
+                int blockNum = AllocateFileBlock(inodeEntry, lastBlock, i, end - i, adoptDelayed);
+                if (blockNum == ERROR) {
+                    status = ERROR;
+                    break;
+                }
+                inodeInfo->direct[i] = blockNum;
+                if (blockMap != NULL) {
+                    blockMap[i] = blockNum;
+                }
+                if (i >= newCursor) {
+                    newCursor = i + 1;
+                }
+                MarkInodeEntryDirty(inodeEntry);
+            }
+            lastBlock = inodeInfo->direct[i];
+        }
+        if (i < end && i < MAPPED_FILE_BLOCKS && status == 0) {
+            // AllocateBlock hands out a zeroed block, which reads as an indirect block of holes. It comes from
+            // outside the file's reserved run so the data blocks on either side of it stay contiguous
+            if (inodeInfo->indirect == 0) {
+                int blockNum = AllocateBlock();
+                if (blockNum == ERROR) {
+                    status = ERROR;
+                }
+                else {
+                    inodeInfo->indirect = blockNum;
+                    MarkInodeEntryDirty(inodeEntry);
+                }
+            }
+            struct BlockCacheEntry *indirectEntry = (status == 0) ? GetBlockFromCache(inodeInfo->indirect) : NULL;
+            if (indirectEntry == NULL) {
+                status = ERROR;
+            }
+            else {
+                // AllocateBlock pulls each new block into the cache, keep the indirect block from being evicted meanwhile
+                PinBlock(indirectEntry);
+                int *blockNums = (int *)indirectEntry->data;
+                if (lastBlock == 0 && i > NUM_DIRECT) {
+                    lastBlock = blockNums[i - 1 - NUM_DIRECT];
+                }
+                for (; i < end && i < MAPPED_FILE_BLOCKS; i++) {
+                    if (blockNums[i - NUM_DIRECT] == 0) {
+                        int blockNum = AllocateFileBlock(inodeEntry, lastBlock, i, end - i, adoptDelayed);
+                        if (blockNum == ERROR) {
+                            status = ERROR;
+                            break;
+                        }
+                        blockNums[i - NUM_DIRECT] = blockNum;
+                        if (blockMap != NULL) {
+                            blockMap[i] = blockNum;
+                        }
+                        if (i >= newCursor) {
+                            newCursor = i + 1;
+                        }
+                        MarkBlockEntryDirty(indirectEntry);
+                    }
+                    lastBlock = blockNums[i - NUM_DIRECT];
+                }
+                UnpinBlock(indirectEntry);
+            }
+        }
+        // Past the block map, a leaf of the double or triple indirect tree at a time
+        while (i < end && status == 0) {
+            int leafEnd = i + INDIRECT_BLOCK_NUMS - (i - MAPPED_FILE_BLOCKS) % INDIRECT_BLOCK_NUMS;
+            if (leafEnd > end) {
+                leafEnd = end;
+            }
+            int leaf = GetTreeLeaf(inodeEntry, i, &lastBlock);
+            struct BlockCacheEntry *leafEntry = (leaf == ERROR) ? NULL : GetBlockFromCache(leaf);
+            if (leafEntry == NULL) {
+                status = ERROR;
+                break;
+            }
+            PinBlock(leafEntry);
+            int *blockNums = (int *)leafEntry->data;
+            if (lastBlock == 0 && (i - MAPPED_FILE_BLOCKS) % INDIRECT_BLOCK_NUMS > 0) {
+                lastBlock = blockNums[(i - MAPPED_FILE_BLOCKS) % INDIRECT_BLOCK_NUMS - 1];
+            }
+            for (; i < leafEnd; i++) {
+                int *entry = &blockNums[(i - MAPPED_FILE_BLOCKS) % INDIRECT_BLOCK_NUMS];
+                if (*entry == 0) {
+                    int blockNum = AllocateFileBlock(inodeEntry, lastBlock, i, end - i, adoptDelayed);
+                    if (blockNum == ERROR) {
+                        status = ERROR;
+                        break;
+                    }
+                    *entry = blockNum;
+                    if (i >= newCursor) {
+                        newCursor = i + 1;
+                    }
+                    MarkBlockEntryDirty(leafEntry);
+                }
+                lastBlock = *entry;
+            }
+            UnpinBlock(leafEntry);
+        }
+        inodeEntry->blockCursor = newCursor;
+        if (status == ERROR) {
+            return ERROR;
+        }
+    }
+    if (blocks == NULL) {
+        return 0;
+    }
+
+    // Past the cursor there are only the delayed run and holes
+    int cursor = GetAllocationCursor(inodeEntry);
+    if (cursor == ERROR) {
+        return ERROR;
+    }
+    int mappedEnd = (end < cursor) ? end : (start > cursor) ? start : cursor;
+    int slot = GetInodeCacheSlot(inodeEntry);
+    for (int i = mappedEnd; i < end; i++) {
+        int delayed = (i >= inodeEntry->delayedStart && i < inodeEntry->delayedStart + inodeEntry->delayedBlocks);
+        blocks[i - start] = delayed ? DELAYED_BLOCK_KEY(slot, i) : 0;
+    }
+
+    // Ranges within the direct blocks are read off the inode, up to MAPPED_FILE_BLOCKS they need the block map
+    int mapEnd = (mappedEnd < MAPPED_FILE_BLOCKS) ? mappedEnd : MAPPED_FILE_BLOCKS;
+    int *blockMap = inodeInfo->direct;
+    if (mapEnd > start && mapEnd > NUM_DIRECT) {
+        blockMap = LoadBlockMap(inodeEntry);
+        if (blockMap == NULL) {
+            return ERROR;
+        }
+    }
+    for (int i = start; i < mapEnd; i++) {
+        blocks[i - start] = blockMap[i];
+    }
+
+    // Further on they come from the leaves of the trees, a missing leaf is a hole
+    for (int i = (start > MAPPED_FILE_BLOCKS) ? start : MAPPED_FILE_BLOCKS; i < mappedEnd; ) {
+        int leafEnd = i + INDIRECT_BLOCK_NUMS - (i - MAPPED_FILE_BLOCKS) % INDIRECT_BLOCK_NUMS;
+        if (leafEnd > mappedEnd) {
+            leafEnd = mappedEnd;
+        }
+        int leaf = GetTreeLeaf(inodeEntry, i, NULL);
+        int *blockNums = NULL;
+        if (leaf == ERROR) {
+            return ERROR;
+        }
+        if (leaf != 0) {
+            struct BlockCacheEntry *leafEntry = GetBlockFromCache(leaf);
+            if (leafEntry == NULL) {
+                return ERROR;
+            }
+            blockNums = (int *)leafEntry->data;
+        }
+        for (; i < leafEnd; i++) {
+            blocks[i - start] = (blockNums != NULL) ? blockNums[(i - MAPPED_FILE_BLOCKS) % INDIRECT_BLOCK_NUMS] : 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Make sure logical blocks [start, end) of a regular file exist, for a write. Holes inside the file are
+ * allocated right away, blocks past its end become delayed blocks and the blocks in between stay holes.
+ * Delayed blocks are zero filled in the cache and the free blocks they will need are promised right away,
+ * so running out of space is still reported to the write. A file has one run of delayed blocks, a write that
+ * does not continue it has the run allocated first, as does a write too big to wait in the cache or one that
+ * would push the delayed blocks past DELAYED_BLOCK_LIMIT
+ * @param inodeEntry The inode cache entry of the file
+ * @param start The first logical block the write touches
+ * @param end One past the last logical block the write touches
+ * @return 0 on success, ERROR if there is not enough free space
+ */
+int DelayBlockRange(struct InodeCacheEntry *inodeEntry, int start, int end) {
+    if (start < 0 || end > MAX_FILE_BLOCKS) {
+        return ERROR;
+    }
+    if (start >= end) {
+        return 0;
+    }
+    CheckBlockMapReuse(inodeEntry);
+    if (GetAllocationCursor(inodeEntry) == ERROR) {
+        return ERROR;
+    }
+    int runEnd = inodeEntry->delayedStart + inodeEntry->delayedBlocks;
+    if (inodeEntry->delayedBlocks > 0 && ((start < inodeEntry->delayedStart && end > inodeEntry->delayedStart) || start > runEnd)) {
+        if (AllocateDelayedBlocks(inodeEntry) == ERROR) {
+            return ERROR;
+        }
+    }
+
+    // Blocks before the delayed run, or before the cursor if there is none, can only be holes
+    int first = (inodeEntry->delayedBlocks > 0) ? inodeEntry->delayedStart : inodeEntry->blockCursor;
+    if (start < first) {
+        int holesEnd = (end < first) ? end : first;
+        if (MapBlockRange(inodeEntry, start, holesEnd, NULL, MAP_ALLOCATE) == ERROR) {
+            return ERROR;
+        }
+        start = holesEnd;
+        if (start == end) {
+            return 0;
+        }
+    }
+    if (inodeEntry->delayedBlocks == 0) {
+        inodeEntry->delayedStart = start;
+    }
+    runEnd = inodeEntry->delayedStart + inodeEntry->delayedBlocks;
+    int newBlocks = end - runEnd;
+    if (newBlocks <= 0) {
+        return 0;
+    }
+    if (newBlocks > DELAYED_BLOCK_LIMIT) {
+        return MapBlockRange(inodeEntry, start, end, NULL, MAP_ALLOCATE);
+    }
+    if (delayedBlocksCached + newBlocks > DELAYED_BLOCK_LIMIT) {
+        AllocateAllDelayedBlocks();
+        if (inodeEntry->delayedBlocks == 0) {
+            inodeEntry->delayedStart = runEnd;
+        }
+    }
+    // The root table is not part of the promise, a file reaching into the trees has it reserved now
+    if (end > MAPPED_FILE_BLOCKS && inodeEntry->inodeInfo->type == INODE_REGULAR &&
+        GetRootTableBlock(inodeEntry->inodeNumber, 1) == NULL) {
+        return ERROR;
+    }
+
+    inodeEntry->delayedBlocks += newBlocks;
+    int needed = DelayedBlocksPromise(inodeEntry) - inodeEntry->delayedPromise;
+    inodeEntry->delayedBlocks -= newBlocks;
+    if (freeBlocksCount - freeBlocksPromised < needed) {
+        ReleaseAllBlockReservations();
+    }
+    if (freeBlocksCount - freeBlocksPromised < needed) {
+        TracePrintf(0, "DelayBlockRange: %d free blocks needed for inode %d, %d left\n", needed, inodeEntry->inodeNumber,
+            freeBlocksCount - freeBlocksPromised);
+        return ERROR;
+    }
+
+    int slot = GetInodeCacheSlot(inodeEntry);
+    int status = 0;
+    while (newBlocks > 0) {
+        if (CreateDelayedBlock(DELAYED_BLOCK_KEY(slot, inodeEntry->delayedStart + inodeEntry->delayedBlocks)) == NULL) {
+            status = ERROR;
+            break;
+        }
+        inodeEntry->delayedBlocks++;
+        delayedBlocksCached++;
+        newBlocks--;
+    }
+    UpdateDelayedPromise(inodeEntry);
+    return status;
+}
+
+/**
+ * Give the delayed blocks of a file their disk blocks, all in one go so they can form one contiguous run.
+ * The blocks promised to them are handed back to the free space just before they are allocated
+ * @param inodeEntry The inode cache entry of the file
+ * @return 0 on success, ERROR if not all of them could be allocated (the rest stay delayed)
+ */
+int AllocateDelayedBlocks(struct InodeCacheEntry *inodeEntry) {
+    CheckBlockMapReuse(inodeEntry);
+    int delayed = inodeEntry->delayedBlocks;
+    if (delayed == 0) {
+        return 0;
+    }
+    int start = inodeEntry->delayedStart;
+    TracePrintf(0, "AllocateDelayedBlocks: Allocating %d delayed blocks of inode %d\n", delayed, inodeEntry->inodeNumber);
+    delayedBlocksCached -= delayed;
+    inodeEntry->delayedBlocks = 0;
+    UpdateDelayedPromise(inodeEntry);
+
+    // The run is allocated in order, so the blocks it got are the ones before the new cursor
+    int status = MapBlockRange(inodeEntry, start, start + delayed, NULL, MAP_ALLOCATE_DELAYED);
+    int allocated = (inodeEntry->blockCursor > start) ? inodeEntry->blockCursor - start : 0;
+    delayedBlocksAllocated += allocated;
+    delayedAllocations++;
+    if (status == ERROR) {
+        TracePrintf(0, "AllocateDelayedBlocks: Only %d of %d delayed blocks of inode %d allocated\n",
+            allocated, delayed, inodeEntry->inodeNumber);
+        inodeEntry->delayedStart = start + allocated;
+        inodeEntry->delayedBlocks = delayed - allocated;
+        delayedBlocksCached += delayed - allocated;
+        UpdateDelayedPromise(inodeEntry);
+    }
+    return status;
+}
+
+/**
+ * Give the delayed blocks of every cached file their disk blocks, before a sync and when too many are waiting
+ */
+void AllocateAllDelayedBlocks() {
+    for (struct InodeCacheEntry *inodeEntry = inodeCacheLruHead; inodeEntry != NULL; inodeEntry = inodeEntry->lruNext) {
+        AllocateDelayedBlocks(inodeEntry);
+    }
+}
+
+/**
+ * Drop the data blocks past keepBlocks from the allocation cursor and the block map, after ShrinkFile freed them,
+ * throw away the delayed blocks past keepBlocks and release the blocks reserved for the file.
+ * The rest of a decoded map still matches the inode and stays valid
+ * @param inodeEntry The inode cache entry of the file
+ * @param keepBlocks The number of data blocks the file has left
+ */
+void TrimBlockMap(struct InodeCacheEntry *inodeEntry, int keepBlocks) {
+    CheckBlockMapReuse(inodeEntry);
+    ReleaseBlockReservation(inodeEntry);
+    if (inodeEntry->delayedBlocks > 0) {
+        int keepDelayed = keepBlocks - inodeEntry->delayedStart;
+        DropDelayedBlocks(inodeEntry, (keepDelayed > 0) ? keepDelayed : 0);
+    }
+    if (inodeEntry->blockCursor > keepBlocks) {
+        if (inodeEntry->blockMapValid) {
+            for (int i = keepBlocks; i < inodeEntry->blockCursor && i < MAPPED_FILE_BLOCKS; i++) {
+                inodeEntry->blockMap[i] = 0;
+            }
+        }
+        inodeEntry->blockCursor = keepBlocks;
+    }
+}
+
+/**
+ * Free the data blocks a shrinking file has in an indirect tree from logical block keepBlocks on,
+ * and the indirect blocks below blockNum that are left without entries
+ * @param blockNum An indirect block of the tree
+ * @param depth 1 for a leaf, up to 3 for the root of the triple indirect tree
+ * @param base The logical block of the first entry under blockNum
+ * @param keepBlocks The number of logical blocks the file keeps
+ * @return 1 if blockNum has no entries left and can be freed itself, 0 otherwise
+ */
+static int FreeTreeRange(int blockNum, int depth, int base, int keepBlocks) {
+    struct BlockCacheEntry *indirectEntry = GetBlockFromCache(blockNum);
+    if (indirectEntry == NULL) {
+        return 0;
+    }
+    int span = (depth == 3) ? DOUBLE_INDIRECT_BLOCKS : (depth == 2) ? INDIRECT_BLOCK_NUMS : 1;
+    int *blockNums = (int *)indirectEntry->data;
+    int empty = 1;
+    // Freeing the subtrees goes through the cache, keep this block from being evicted meanwhile
+    PinBlock(indirectEntry);
+    for (int k = 0; k < INDIRECT_BLOCK_NUMS; k++) {
+        int first = base + k * span;
+        if (blockNums[k] == 0) {
+            continue;
+        }
+        if (first + span <= keepBlocks) {
+            empty = 0;
+        }
+        else if (depth == 1 || FreeTreeRange(blockNums[k], depth - 1, first, keepBlocks)) {
+            TracePrintf(0, "FreeTreeRange: Freeing %s block %d\n", (depth == 1) ? "data" : "indirect", blockNums[k]);
+            FreeBlock(blockNums[k]);
+            blockNums[k] = 0;
+            MarkBlockEntryDirty(indirectEntry);
+        }
+        else {
+            empty = 0;
+        }
+    }
+    UnpinBlock(indirectEntry);
+    return empty;
+}
+
+/**
+ * Free the blocks of the double and triple indirect trees of a file from logical block keepBlocks on,
+ * and every indirect block, roots included, that is left empty. Called by ShrinkFile
+ * @param inodeEntry The inode cache entry of the file
+ * @param keepBlocks The number of logical blocks the file keeps
+ */
+void FreeTreeBlocks(struct InodeCacheEntry *inodeEntry, int keepBlocks) {
+    int cursor = GetAllocationCursor(inodeEntry);
+    if (cursor <= MAPPED_FILE_BLOCKS || cursor <= keepBlocks) {
+        return;
+    }
+    int *roots = GetTreeRoots(inodeEntry);
+    if (roots == NULL) {
+        return;
+    }
+    if (roots[1] != 0 && FreeTreeRange(roots[1], 3, MAPPED_FILE_BLOCKS + DOUBLE_INDIRECT_BLOCKS, keepBlocks)) {
+        TracePrintf(0, "FreeTreeBlocks: Freeing triple indirect block %d\n", roots[1]);
+        FreeBlock(roots[1]);
+        SetTreeRoot(inodeEntry, 3, 0);
+    }
+    if (roots[0] != 0 && FreeTreeRange(roots[0], 2, MAPPED_FILE_BLOCKS, keepBlocks)) {
+        TracePrintf(0, "FreeTreeBlocks: Freeing double indirect block %d\n", roots[0]);
+        FreeBlock(roots[0]);
+        SetTreeRoot(inodeEntry, 2, 0);
+    }
+}
+
+/**
+ * Make sure a newly created file does not pick up trees left in the root table by an earlier use of its inode
+ * @param inodeNumber The inode of the new file
+ */
+void ClearTreeRoots(int inodeNumber) {
+    struct BlockCacheEntry *tableEntry = GetRootTableBlock(inodeNumber, 0);
+    if (tableEntry == NULL) {
+        return;
+    }
+    struct inode_roots *roots = (struct inode_roots *)tableEntry->data + inodeNumber % ROOTS_PER_BLOCK;
+    if (roots->doubleIndirect != 0 || roots->tripleIndirect != 0) {
+        TracePrintf(0, "ClearTreeRoots: Inode %d still had indirect trees\n", inodeNumber);
+        roots->doubleIndirect = 0;
+        roots->tripleIndirect = 0;
+        MarkBlockEntryDirty(tableEntry);
+    }
+}
+
+/**
+ * Check whether the data of a file or symbolic link is stored inline in its inode
+ * @param inodeInfo The inode
+ * @return 1 if it is, 0 if the file uses blocks
+ */
+int HasInlineData(struct inode *inodeInfo) {
+    return inodeInfo->indirect == INLINE_DATA_MARK;
+}
+
+/**
+ * Get the inline data of a file or symbolic link
+ * @param inodeInfo The inode, with inline data
+ * @return The INLINE_DATA_SIZE bytes of data, zero past the size of the file
+ */
+char *GetInlineData(struct inode *inodeInfo) {
+    return (char *)inodeInfo->direct;
+}
+
+/**
+ * Store the data of a file or symbolic link that has no blocks inline
+ * @param inodeInfo The inode, without blocks
+ * @param data The data, or NULL to store nothing yet
+ * @param size The number of bytes of data, at most INLINE_DATA_SIZE
+ */
+void SetInlineData(struct inode *inodeInfo, char *data, int size) {
+    memset(inodeInfo->direct, 0, sizeof(inodeInfo->direct));
+    if (data != NULL) {
+        memcpy(inodeInfo->direct, data, size);
+    }
+    inodeInfo->indirect = INLINE_DATA_MARK;
+    inlineFilesStored++;
+}
+
+/**
+ * Move the inline data of a file to its first block, a delayed block like any other appended block.
+ * Once the data is in the cache block, the inode goes back to an empty block map
+ * @param inodeEntry The inode cache entry of the file
+ * @return 0 on success, ERROR if there is no free block for it
+ */
+static int MoveInlineData(struct InodeCacheEntry *inodeEntry) {
+    struct inode *inodeInfo = inodeEntry->inodeInfo;
+    char data[INLINE_DATA_SIZE];
+    memcpy(data, GetInlineData(inodeInfo), INLINE_DATA_SIZE);
+    memset(inodeInfo->direct, 0, sizeof(inodeInfo->direct));
+    inodeInfo->indirect = 0;
+    inodeEntry->blockCursor = 0;
+    MarkInodeEntryDirty(inodeEntry);
+
+    int blockNum;
+    struct BlockCacheEntry *blockEntry = NULL;
+    if (DelayBlockRange(inodeEntry, 0, 1) == 0 && MapBlockRange(inodeEntry, 0, 1, &blockNum, MAP_RESOLVE) == 0 && blockNum != 0) {
+        blockEntry = GetBlockFromCache(blockNum);
+    }
+    if (blockEntry == NULL) {
+        // Without a block the data stays where it was
+        DropDelayedBlocks(inodeEntry, 0);
+        memcpy(inodeInfo->direct, data, INLINE_DATA_SIZE);
+        inodeInfo->indirect = INLINE_DATA_MARK;
+        return ERROR;
+    }
+    memcpy(blockEntry->data, data, INLINE_DATA_SIZE);
+    MarkBlockEntryDirty(blockEntry);
+    inlineFilesMoved++;
+    TracePrintf(0, "MoveInlineData: Moved the inline data of inode %d to a block\n", inodeEntry->inodeNumber);
+    return 0;
+}
+
+/**
+ * Decide where a write to a regular file goes. An empty file without blocks takes data up to INLINE_DATA_SIZE inline,
+ * an inline file keeps its data inline as long as the write fits, and otherwise moves it to a block first
+ * @param inodeEntry The inode cache entry of the file
+ * @param end One past the last byte the write touches
+ * @return 1 if the write goes to the inline data, 0 if it goes to blocks, ERROR if the data could not be moved
+ */
+int PrepareInlineWrite(struct InodeCacheEntry *inodeEntry, int end) {
+    struct inode *inodeInfo = inodeEntry->inodeInfo;
+    if (HasInlineData(inodeInfo)) {
+        if (end <= INLINE_DATA_SIZE) {
+            return 1;
+        }
+        return MoveInlineData(inodeEntry);
+    }
+    if (end > INLINE_DATA_SIZE || inodeInfo->size > 0 || GetAllocationCursor(inodeEntry) != 0 || inodeEntry->delayedBlocks > 0) {
+        return 0;
+    }
+    SetInlineData(inodeInfo, NULL, 0);
+    MarkInodeEntryDirty(inodeEntry);
+    return 1;
+}
+
+/**
+ * Cut the inline data of a file to newSize bytes. The bytes past it are zeroed, so a later write past the end
+ * leaves zeros in between, and a file cut to 0 bytes goes back to an empty block map
+ * @param inodeInfo The inode, with inline data
+ * @param newSize The new size, not larger than the current size
+ */
+void TrimInlineData(struct inode *inodeInfo, int newSize) {
+    if (newSize >= INLINE_DATA_SIZE) {
+        return;
+    }
+    memset(GetInlineData(inodeInfo) + newSize, 0, INLINE_DATA_SIZE - newSize);
+    if (newSize == 0) {
+        inodeInfo->indirect = 0;
+    }
+}
+
+/**
+ * Print how often block maps were decoded from indirect blocks, how many file blocks were allocated in place,
+ * how the delayed blocks were allocated and how many files were stored inline
+ */
+void PrintBlockMapStats() {
+    TracePrintf(0, "PrintBlockMapStats: %d block maps decoded\n", blockMapLoads);
+    TracePrintf(0, "PrintBlockMapStats: %d file blocks allocated, %d right after the previous block of their file\n",
+        fileBlocksAllocated, fileBlocksContiguous);
+    TracePrintf(0, "PrintBlockMapStats: %d delayed blocks allocated in %d runs\n", delayedBlocksAllocated, delayedAllocations);
+    TracePrintf(0, "PrintBlockMapStats: %d files stored inline, %d of them moved to a block\n", inlineFilesStored, inlineFilesMoved);
+}
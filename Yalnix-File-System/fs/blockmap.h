@@ -0,0 +1,69 @@
+#ifndef _BLOCKMAP_H_
+#define _BLOCKMAP_H_
+
+#include <comp421/yalnix.h>
+#include <comp421/filesystem.h>
+#include "../cache/cache.h"
+
+/**
+ * Mapping of the logical blocks of a file to disk blocks, a range at a time.
+ * Files may have holes, logical blocks that were never written. Their block number is 0 and they read
+ * as zeros. The allocation cursor, one past the last allocated logical block, is kept in the inode cache
+ * entry once found. For files with an indirect block the entry also keeps the disk block numbers of the
+ * direct and single indirect blocks decoded, the block map. Regular files continue in a double and then
+ * a triple indirect tree (struct inode_roots), which are walked through the block cache a leaf at a time.
+ */
+#define INDIRECT_BLOCK_NUMS (int)(BLOCKSIZE / sizeof(int))
+#define MAPPED_FILE_BLOCKS (NUM_DIRECT + INDIRECT_BLOCK_NUMS)
+#define DOUBLE_INDIRECT_BLOCKS (INDIRECT_BLOCK_NUMS * INDIRECT_BLOCK_NUMS)
+#define TRIPLE_INDIRECT_BLOCKS (DOUBLE_INDIRECT_BLOCKS * INDIRECT_BLOCK_NUMS)
+#define MAX_FILE_BLOCKS (MAPPED_FILE_BLOCKS + DOUBLE_INDIRECT_BLOCKS + TRIPLE_INDIRECT_BLOCKS)
+#define BLOCK_MAP_BATCH 128                     // Blocks YfsRead and YfsWrite map per call, 64 KB
+
+/**
+ * Locality-aware allocation: a regular file continues at the disk block after its last one, and when it
+ * has to start a new extent it reserves a run of free blocks to grow into. The run is as long as the file
+ * already is, within [ALLOC_RESERVE_MIN, ALLOC_RESERVE_MAX], so concurrently growing files do not interleave.
+ */
+#define ALLOC_RESERVE_MIN 8
+#define ALLOC_RESERVE_MAX 64
+
+/**
+ * Delayed allocation: YfsWrite appends to a regular file without allocating, the new logical blocks only live
+ * in the block cache (DELAYED_BLOCK_KEY) and their free blocks are promised up front. They get disk blocks in one
+ * contiguous run when the cache is synced, the inode leaves the cache, or more than DELAYED_BLOCK_LIMIT blocks wait.
+ */
+#define DELAYED_BLOCK_LIMIT (BLOCK_CACHESIZE / 4)
+
+/**
+ * Inline data: a regular file of at most INLINE_DATA_SIZE bytes, or the target of a short symbolic link, is kept
+ * in direct[] instead of a data block, marked by INLINE_DATA_MARK in indirect. Reading it needs no block at all.
+ * A write that makes the file larger moves the data to a block first, truncating it to 0 drops the mark
+ */
+#define INLINE_DATA_MARK (-1)
+#define INLINE_DATA_SIZE (int)(sizeof(int) * NUM_DIRECT)
+
+// Modes of MapBlockRange
+#define MAP_RESOLVE 0                           // Look up blocks only, holes map to 0
+#define MAP_ALLOCATE 1                          // Allocate zeroed blocks for the holes in the range first
+#define MAP_ALLOCATE_DELAYED 2                  // Allocate the delayed blocks of the range, keeping their cached data
+
+void DecodeBlockMap(struct inode *inodeInfo, int *indirectBlockNums, int *blocks, int count);
+int GetAllocationCursor(struct InodeCacheEntry *inodeEntry);
+int MapBlockRange(struct InodeCacheEntry *inodeEntry, int start, int end, int *blocks, int allocate);
+void TrimBlockMap(struct InodeCacheEntry *inodeEntry, int keepBlocks);
+void FreeTreeBlocks(struct InodeCacheEntry *inodeEntry, int keepBlocks);
+void ClearTreeRoots(int inodeNumber);
+void ReleaseBlockReservation(struct InodeCacheEntry *inodeEntry);
+void ReleaseAllBlockReservations();
+int DelayBlockRange(struct InodeCacheEntry *inodeEntry, int start, int end);
+int AllocateDelayedBlocks(struct InodeCacheEntry *inodeEntry);
+void AllocateAllDelayedBlocks();
+int HasInlineData(struct inode *inodeInfo);
+char *GetInlineData(struct inode *inodeInfo);
+void SetInlineData(struct inode *inodeInfo, char *data, int size);
+int PrepareInlineWrite(struct InodeCacheEntry *inodeEntry, int end);
+void TrimInlineData(struct inode *inodeInfo, int newSize);
+void PrintBlockMapStats();
+
+#endif /* _BLOCKMAP_H_ */
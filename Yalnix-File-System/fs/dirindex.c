@@ -0,0 +1,813 @@
+#include <stdlib.h>
+#include <string.h>
+#include "dirindex.h"
+#include "path.h"
+
+/**
+ * One step of the walk from the root of the index down to a leaf
+ */
+typedef struct IndexPathStep {
+    int block;                  // Logical block of the index node
+    int position;               // Pair followed in that node
+} IndexPathStep;
+
+/**
+ * A live entry collected while an indexed directory is being compacted
+ */
+typedef struct CompactEntry {
+    unsigned int hash;
+    struct dir_entry entry;
+} CompactEntry;
+
+/**
+ * FNV-1a hash of a name, stored on disk so it must never change
+ * @return The hash
+ */
+static unsigned int DirNameHash(char *name, int nameLen) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < nameLen; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Length of the name of a directory entry, which is only null terminated when shorter than DIRNAMELEN
+ */
+static int DirEntryNameLen(struct dir_entry *dirEntry) {
+    int nameLen = 0;
+    while (nameLen < DIRNAMELEN && dirEntry->name[nameLen] != '\0') {
+        nameLen++;
+    }
+    return nameLen;
+}
+
+/**
+ * Get a block of a directory from the cache
+ * @param dirInode The inode of the directory
+ * @param logicalBlock The block index within the directory
+ * @return The block cache entry, or NULL on failure
+ */
+static struct BlockCacheEntry *GetDirectoryBlock(struct inode *dirInode, int logicalBlock) {
+    int blockNumber;
+    if (logicalBlock < NUM_DIRECT) {
+        blockNumber = dirInode->direct[logicalBlock];
+    }
+    else {
+        blockNumber = GetDataBlockNumberFromIndirectBlock(dirInode->indirect, logicalBlock - NUM_DIRECT);
+    }
+    if (blockNumber <= 0) {
+        return NULL;
+    }
+    return GetBlockFromCache(blockNumber);
+}
+
+/**
+ * Copy a block of a directory into buf
+ * @return 0 on success, ERROR on failure
+ */
+static int ReadDirectoryBlock(struct inode *dirInode, int logicalBlock, char *buf) {
+    struct BlockCacheEntry *blockEntry = GetDirectoryBlock(dirInode, logicalBlock);
+    if (blockEntry == NULL) {
+        return ERROR;
+    }
+    memcpy(buf, blockEntry->data, BLOCKSIZE);
+    return 0;
+}
+
+/**
+ * Copy buf over a block of a directory
+ * @return 0 on success, ERROR on failure
+ */
+static int WriteDirectoryBlock(struct inode *dirInode, int logicalBlock, char *buf) {
+    struct BlockCacheEntry *blockEntry = GetDirectoryBlock(dirInode, logicalBlock);
+    if (blockEntry == NULL) {
+        return ERROR;
+    }
+    memcpy(blockEntry->data, buf, BLOCKSIZE);
+    MarkBlockEntryDirty(blockEntry);
+    return 0;
+}
+
+/**
+ * Grow a directory by one zeroed block, which reads as a block of free entries
+ * @param dirInodeEntry The inode cache entry of the directory
+ * @return The logical block number of the new block, or ERROR on failure
+ */
+static int AppendDirectoryBlock(struct InodeCacheEntry *dirInodeEntry) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    int logicalBlock = dirInode->size / BLOCKSIZE;
+    if (logicalBlock >= DIR_INDEX_MAX_BLOCKS || (logicalBlock + 1) * BLOCKSIZE > MAX_DIRECTORY_SIZE) {
+        return ERROR;
+    }
+    if (AllocateBlockInInode(dirInodeEntry) < 0) {
+        return ERROR;
+    }
+    dirInode->size += BLOCKSIZE;
+    MarkInodeEntryDirty(dirInodeEntry);
+    return logicalBlock;
+}
+
+static struct dir_index_header *IndexHeader(char *node, int logicalBlock) {
+    int headerSlot = (logicalBlock == 0) ? DIR_INDEX_ROOT_SLOT : 0;
+    return (struct dir_index_header *)(node + headerSlot * sizeof(struct dir_entry));
+}
+
+static struct dir_index_slot *IndexSlots(char *node, int logicalBlock) {
+    return (struct dir_index_slot *)(IndexHeader(node, logicalBlock) + 1);
+}
+
+static int IndexCapacity(int logicalBlock) {
+    int headerSlot = (logicalBlock == 0) ? DIR_INDEX_ROOT_SLOT : 0;
+    return (DIRENTRY_PER_BLOCK - headerSlot - 1) * DIR_INDEX_PAIRS_PER_SLOT;
+}
+
+static unsigned int GetIndexHash(struct dir_index_slot *slots, int k) {
+    return slots[k / DIR_INDEX_PAIRS_PER_SLOT].hash[k % DIR_INDEX_PAIRS_PER_SLOT];
+}
+
+static int GetIndexBlock(struct dir_index_slot *slots, int k) {
+    return slots[k / DIR_INDEX_PAIRS_PER_SLOT].block[k % DIR_INDEX_PAIRS_PER_SLOT];
+}
+
+static void SetIndexPair(struct dir_index_slot *slots, int k, unsigned int hash, int block) {
+    slots[k / DIR_INDEX_PAIRS_PER_SLOT].hash[k % DIR_INDEX_PAIRS_PER_SLOT] = hash;
+    slots[k / DIR_INDEX_PAIRS_PER_SLOT].block[k % DIR_INDEX_PAIRS_PER_SLOT] = block;
+}
+
+/**
+ * Binary search an index node for the pair covering a hash, the first pair always starts at hash 0
+ * @return The position of the last pair whose hash is <= hash
+ */
+static int FindIndexPosition(struct dir_index_slot *slots, int count, unsigned int hash) {
+    int low = 0;
+    int high = count - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (GetIndexHash(slots, mid) <= hash) {
+            low = mid;
+        }
+        else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+/**
+ * Check whether a directory uses the indexed layout
+ * @param dirInodeEntry The inode cache entry of the directory
+ * @return 1 if the directory is indexed, 0 if it is a plain array of entries
+ */
+int IsIndexedDirectory(struct InodeCacheEntry *dirInodeEntry) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    if (dirInode->type != INODE_DIRECTORY || dirInode->size < 2 * BLOCKSIZE) {
+        return 0;
+    }
+    struct BlockCacheEntry *blockEntry = GetDirectoryBlock(dirInode, 0);
+    if (blockEntry == NULL) {
+        return 0;
+    }
+    struct dir_index_header *header = IndexHeader(blockEntry->data, 0);
+    return header->inum == 0 && header->magic == DIR_INDEX_MAGIC;
+}
+
+/**
+ * Walk the index from the root down to the leaf covering a hash
+ * @param dirInode The inode of an indexed directory
+ * @param hash The name hash
+ * @param path If not NULL, filled with the node and position used at each level, indexed by level
+ * @param levels Set to the number of index levels
+ * @return The logical block of the leaf, or ERROR if the index is damaged
+ */
+static int FindLeaf(struct inode *dirInode, unsigned int hash, IndexPathStep *path, int *levels) {
+    struct BlockCacheEntry *blockEntry = GetDirectoryBlock(dirInode, 0);
+    if (blockEntry == NULL) {
+        return ERROR;
+    }
+    *levels = IndexHeader(blockEntry->data, 0)->levels;
+    if (*levels < 1 || *levels > DIR_INDEX_MAX_LEVELS) {
+        return ERROR;
+    }
+
+    int logicalBlock = 0;
+    for (int level = *levels; level >= 1; level--) {
+        blockEntry = GetDirectoryBlock(dirInode, logicalBlock);
+        if (blockEntry == NULL) {
+            return ERROR;
+        }
+        struct dir_index_header *header = IndexHeader(blockEntry->data, logicalBlock);
+        if (header->magic != DIR_INDEX_MAGIC || header->count < 1 || header->count > IndexCapacity(logicalBlock)) {
+            return ERROR;
+        }
+        struct dir_index_slot *slots = IndexSlots(blockEntry->data, logicalBlock);
+        int position = FindIndexPosition(slots, header->count, hash);
+        if (path != NULL) {
+            path[level].block = logicalBlock;
+            path[level].position = position;
+        }
+        logicalBlock = GetIndexBlock(slots, position);
+        if (logicalBlock <= 0 || logicalBlock >= dirInode->size / BLOCKSIZE) {
+            return ERROR;
+        }
+    }
+    return logicalBlock;
+}
+
+/**
+ * Insert a pair into an index node that has room for it
+ * @param dirInode The inode of the directory
+ * @param nodeBlock The logical block of the index node
+ * @param position Where the pair goes, later pairs move up by one
+ * @param hash The lowest hash covered by the child
+ * @param childBlock The logical block of the child
+ * @return 0 on success, ERROR on failure
+ */
+static int InsertIndexPair(struct inode *dirInode, int nodeBlock, int position, unsigned int hash, int childBlock) {
+    char node[BLOCKSIZE];
+    if (ReadDirectoryBlock(dirInode, nodeBlock, node) == ERROR) {
+        return ERROR;
+    }
+    struct dir_index_header *header = IndexHeader(node, nodeBlock);
+    struct dir_index_slot *slots = IndexSlots(node, nodeBlock);
+    for (int k = header->count; k > position; k--) {
+        SetIndexPair(slots, k, GetIndexHash(slots, k - 1), GetIndexBlock(slots, k - 1));
+    }
+    SetIndexPair(slots, position, hash, childBlock);
+    header->count += 1;
+    return WriteDirectoryBlock(dirInode, nodeBlock, node);
+}
+
+/**
+ * Add a level to the index: the pairs of the full root move into a new index block and the root points to it
+ * @param dirInodeEntry The inode cache entry of the directory
+ * @return 0 on success, ERROR on failure
+ */
+static int GrowIndexRoot(struct InodeCacheEntry *dirInodeEntry) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    char root[BLOCKSIZE];
+    char child[BLOCKSIZE];
+    if (ReadDirectoryBlock(dirInode, 0, root) == ERROR) {
+        return ERROR;
+    }
+    struct dir_index_header *rootHeader = IndexHeader(root, 0);
+    if (rootHeader->levels >= DIR_INDEX_MAX_LEVELS) {
+        return ERROR;
+    }
+    int childBlock = AppendDirectoryBlock(dirInodeEntry);
+    if (childBlock == ERROR) {
+        return ERROR;
+    }
+    TracePrintf(0, "GrowIndexRoot: Moving %d root pairs into block %d\n", rootHeader->count, childBlock);
+
+    memset(child, 0, BLOCKSIZE);
+    struct dir_index_header *childHeader = IndexHeader(child, childBlock);
+    struct dir_index_slot *rootSlots = IndexSlots(root, 0);
+    struct dir_index_slot *childSlots = IndexSlots(child, childBlock);
+    childHeader->magic = DIR_INDEX_MAGIC;
+    childHeader->count = rootHeader->count;
+    for (int k = 0; k < rootHeader->count; k++) {
+        SetIndexPair(childSlots, k, GetIndexHash(rootSlots, k), GetIndexBlock(rootSlots, k));
+    }
+
+    memset(rootSlots, 0, IndexCapacity(0) / DIR_INDEX_PAIRS_PER_SLOT * sizeof(struct dir_index_slot));
+    SetIndexPair(rootSlots, 0, 0, childBlock);
+    rootHeader->count = 1;
+    rootHeader->levels += 1;
+
+    if (WriteDirectoryBlock(dirInode, childBlock, child) == ERROR) {
+        return ERROR;
+    }
+    return WriteDirectoryBlock(dirInode, 0, root);
+}
+
+/**
+ * Split a full index node below the root, moving its upper half into a new index block
+ * @param dirInodeEntry The inode cache entry of the directory
+ * @param path The walk to the node, the parent of the node must have room for one more pair
+ * @param level The level of the node in path
+ * @return 0 on success, ERROR on failure
+ */
+static int SplitIndexNode(struct InodeCacheEntry *dirInodeEntry, IndexPathStep *path, int level) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    int nodeBlock = path[level].block;
+    char node[BLOCKSIZE];
+    char sibling[BLOCKSIZE];
+    if (ReadDirectoryBlock(dirInode, nodeBlock, node) == ERROR) {
+        return ERROR;
+    }
+    int siblingBlock = AppendDirectoryBlock(dirInodeEntry);
+    if (siblingBlock == ERROR) {
+        return ERROR;
+    }
+
+    struct dir_index_header *header = IndexHeader(node, nodeBlock);
+    struct dir_index_slot *slots = IndexSlots(node, nodeBlock);
+    int mid = header->count / 2;
+    unsigned int splitHash = GetIndexHash(slots, mid);
+    TracePrintf(0, "SplitIndexNode: Splitting index block %d at hash %u into block %d\n", nodeBlock, splitHash, siblingBlock);
+
+    memset(sibling, 0, BLOCKSIZE);
+    struct dir_index_header *siblingHeader = IndexHeader(sibling, siblingBlock);
+    struct dir_index_slot *siblingSlots = IndexSlots(sibling, siblingBlock);
+    siblingHeader->magic = DIR_INDEX_MAGIC;
+    siblingHeader->count = header->count - mid;
+    for (int k = mid; k < header->count; k++) {
+        SetIndexPair(siblingSlots, k - mid, GetIndexHash(slots, k), GetIndexBlock(slots, k));
+        SetIndexPair(slots, k, 0, 0);
+    }
+    header->count = mid;
+
+    if (WriteDirectoryBlock(dirInode, nodeBlock, node) == ERROR ||
+        WriteDirectoryBlock(dirInode, siblingBlock, sibling) == ERROR) {
+        return ERROR;
+    }
+    return InsertIndexPair(dirInode, path[level + 1].block, path[level + 1].position + 1, splitHash, siblingBlock);
+}
+
+/**
+ * Split a full leaf, moving the entries with the higher half of the hashes into a new leaf.
+ * Entries with equal hashes always stay in the same leaf
+ * @param dirInodeEntry The inode cache entry of the directory
+ * @param path The walk to the leaf, the parent of the leaf must have room for one more pair
+ * @param leafBlock The logical block of the leaf
+ * @return 0 on success, ERROR on failure
+ */
+static int SplitLeaf(struct InodeCacheEntry *dirInodeEntry, IndexPathStep *path, int leafBlock) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    char leaf[BLOCKSIZE];
+    char lower[BLOCKSIZE];
+    char upper[BLOCKSIZE];
+    if (ReadDirectoryBlock(dirInode, leafBlock, leaf) == ERROR) {
+        return ERROR;
+    }
+
+    // Sort the live entries by hash
+    struct dir_entry *entries = (struct dir_entry *)leaf;
+    int order[DIRENTRY_PER_BLOCK];
+    unsigned int hashes[DIRENTRY_PER_BLOCK];
+    int count = 0;
+    for (int i = 0; i < DIRENTRY_PER_BLOCK; i++) {
+        if (entries[i].inum == 0) {
+            continue;
+        }
+        hashes[i] = DirNameHash(entries[i].name, DirEntryNameLen(&entries[i]));
+        int j = count;
+        while (j > 0 && hashes[order[j - 1]] > hashes[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+        count++;
+    }
+
+    // Split in the middle, moving the split point past runs of equal hashes
+    int mid = count / 2;
+    while (mid < count && mid > 0 && hashes[order[mid]] == hashes[order[mid - 1]]) {
+        mid++;
+    }
+    if (mid == count) {
+        mid = count / 2;
+        while (mid > 0 && hashes[order[mid]] == hashes[order[mid - 1]]) {
+            mid--;
+        }
+    }
+    if (mid == 0) {
+        TracePrintf(0, "SplitLeaf: All entries in leaf %d have the same hash\n", leafBlock);
+        return ERROR;
+    }
+
+    int upperBlock = AppendDirectoryBlock(dirInodeEntry);
+    if (upperBlock == ERROR) {
+        return ERROR;
+    }
+    unsigned int splitHash = hashes[order[mid]];
+    TracePrintf(0, "SplitLeaf: Splitting leaf %d at hash %u into block %d\n", leafBlock, splitHash, upperBlock);
+
+    memset(lower, 0, BLOCKSIZE);
+    memset(upper, 0, BLOCKSIZE);
+    for (int k = 0; k < count; k++) {
+        char *target = (k < mid) ? lower + k * sizeof(struct dir_entry) : upper + (k - mid) * sizeof(struct dir_entry);
+        memcpy(target, &entries[order[k]], sizeof(struct dir_entry));
+    }
+    if (WriteDirectoryBlock(dirInode, leafBlock, lower) == ERROR ||
+        WriteDirectoryBlock(dirInode, upperBlock, upper) == ERROR) {
+        return ERROR;
+    }
+    return InsertIndexPair(dirInode, path[1].block, path[1].position + 1, splitHash, upperBlock);
+}
+
+/**
+ * Check whether entries of an indexed directory may sit outside the leaf covering their hash
+ */
+static int IsIndexOverflowed(struct inode *dirInode) {
+    struct BlockCacheEntry *blockEntry = GetDirectoryBlock(dirInode, 0);
+    return blockEntry == NULL || IndexHeader(blockEntry->data, 0)->overflow;
+}
+
+/**
+ * Put an entry into the first free slot of any leaf, once the index can no longer be split.
+ * The root is flagged so that lookups missing in the leaf go on to a linear scan
+ * @return 0 on success, ERROR if the directory has no free slot left
+ */
+static int AddOverflowDirEntry(struct inode *dirInode, int inum, char *name, int nameLen) {
+    struct BlockCacheEntry *rootEntry = GetDirectoryBlock(dirInode, 0);
+    if (rootEntry == NULL) {
+        return ERROR;
+    }
+    struct dir_index_header *rootHeader = IndexHeader(rootEntry->data, 0);
+    if (!rootHeader->overflow) {
+        TracePrintf(0, "AddOverflowDirEntry: Index is full, placing entries in any free leaf slot\n");
+        rootHeader->overflow = 1;
+        MarkBlockEntryDirty(rootEntry);
+    }
+
+    for (int logicalBlock = 1; logicalBlock < dirInode->size / BLOCKSIZE; logicalBlock++) {
+        struct BlockCacheEntry *blockEntry = GetDirectoryBlock(dirInode, logicalBlock);
+        if (blockEntry == NULL) {
+            return ERROR;
+        }
+        // Index blocks start with a header slot, a leaf slot 0 is either a live entry or an all zero free entry
+        struct dir_index_header *header = IndexHeader(blockEntry->data, logicalBlock);
+        if (header->inum == 0 && header->magic == DIR_INDEX_MAGIC) {
+            continue;
+        }
+        struct dir_entry *entries = (struct dir_entry *)blockEntry->data;
+        for (int i = 0; i < DIRENTRY_PER_BLOCK; i++) {
+            if (entries[i].inum == 0) {
+                entries[i].inum = inum;
+                memset(entries[i].name, 0, DIRNAMELEN);
+                memcpy(entries[i].name, name, nameLen);
+                MarkBlockEntryDirty(blockEntry);
+                return 0;
+            }
+        }
+    }
+    return ERROR;
+}
+
+/**
+ * Convert a directory whose only block is full into an indexed directory.
+ * Block 0 keeps "." and ".." and becomes the root of the index, the other entries move into the first leaf
+ * @param dirInodeEntry The inode cache entry of the directory
+ * @return 0 on success, ERROR if the directory cannot be converted
+ */
+int ConvertToIndexedDirectory(struct InodeCacheEntry *dirInodeEntry) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    if (dirInode->type != INODE_DIRECTORY || dirInode->size != BLOCKSIZE) {
+        return ERROR;
+    }
+    char root[BLOCKSIZE];
+    char leaf[BLOCKSIZE];
+    if (ReadDirectoryBlock(dirInode, 0, root) == ERROR) {
+        return ERROR;
+    }
+    struct dir_entry *entries = (struct dir_entry *)root;
+    if (entries[0].inum == 0 || strncmp(entries[0].name, ".", DIRNAMELEN) != 0 ||
+        entries[1].inum == 0 || strncmp(entries[1].name, "..", DIRNAMELEN) != 0) {
+        return ERROR;
+    }
+    int leafBlock = AppendDirectoryBlock(dirInodeEntry);
+    if (leafBlock == ERROR) {
+        return ERROR;
+    }
+    TracePrintf(0, "ConvertToIndexedDirectory: Converting directory %d, first leaf is block %d\n",
+        dirInodeEntry->inodeNumber, leafBlock);
+
+    int movedBytes = BLOCKSIZE - DIR_INDEX_ROOT_SLOT * sizeof(struct dir_entry);
+    memset(leaf, 0, BLOCKSIZE);
+    memcpy(leaf, root + DIR_INDEX_ROOT_SLOT * sizeof(struct dir_entry), movedBytes);
+    memset(root + DIR_INDEX_ROOT_SLOT * sizeof(struct dir_entry), 0, movedBytes);
+
+    struct dir_index_header *header = IndexHeader(root, 0);
+    header->magic = DIR_INDEX_MAGIC;
+    header->levels = 1;
+    header->count = 1;
+    SetIndexPair(IndexSlots(root, 0), 0, 0, leafBlock);
+
+    if (WriteDirectoryBlock(dirInode, leafBlock, leaf) == ERROR) {
+        return ERROR;
+    }
+    return WriteDirectoryBlock(dirInode, 0, root);
+}
+
+/**
+ * Look up a name in an indexed directory, only the leaf covering its hash is scanned
+ * @param dirInodeEntry The inode cache entry of an indexed directory
+ * @param name The name, not necessarily null terminated
+ * @param nameLen The length of the name
+ * @return The inode number, 0 if the name is not found, or ERROR if the index cannot tell (damaged or overflowed)
+ */
+int LookupIndexedDirectory(struct InodeCacheEntry *dirInodeEntry, char *name, int nameLen) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    int levels;
+    int leafBlock = FindLeaf(dirInode, DirNameHash(name, nameLen), NULL, &levels);
+    if (leafBlock == ERROR) {
+        return ERROR;
+    }
+    struct BlockCacheEntry *blockEntry = GetDirectoryBlock(dirInode, leafBlock);
+    if (blockEntry == NULL) {
+        return ERROR;
+    }
+    struct dir_entry *entries = (struct dir_entry *)blockEntry->data;
+    for (int i = 0; i < DIRENTRY_PER_BLOCK; i++) {
+        if (entries[i].inum > 0 && DirEntryNameLen(&entries[i]) == nameLen && memcmp(entries[i].name, name, nameLen) == 0) {
+            return entries[i].inum;
+        }
+    }
+    return IsIndexOverflowed(dirInode) ? ERROR : 0;
+}
+
+/**
+ * Add an entry to an indexed directory, splitting full nodes on the way down and a full leaf as needed.
+ * The caller makes sure the name is not already in the directory
+ * @param dirInodeEntry The inode cache entry of an indexed directory
+ * @param inum The inode number of the entry
+ * @param name The name, at most DIRNAMELEN characters
+ * @param nameLen The length of the name
+ * @return 0 on success, ERROR on failure
+ */
+int AddIndexedDirEntry(struct InodeCacheEntry *dirInodeEntry, int inum, char *name, int nameLen) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    unsigned int hash = DirNameHash(name, nameLen);
+
+    // Every pass either inserts the entry or splits one node, which happens at most once per level and once for the leaf
+    for (int pass = 0; pass < 2 * DIR_INDEX_MAX_LEVELS + 2; pass++) {
+        IndexPathStep path[DIR_INDEX_MAX_LEVELS + 1];
+        int levels;
+        int leafBlock = FindLeaf(dirInode, hash, path, &levels);
+        if (leafBlock == ERROR) {
+            return ERROR;
+        }
+
+        // Once an entry went outside its leaf, splitting could move it into the wrong range
+        if (IsIndexOverflowed(dirInode)) {
+            break;
+        }
+
+        // Split the highest full index node on the walk first, so that a split below it always finds room in its parent
+        int split = 0;
+        for (int level = levels; level >= 1 && !split; level--) {
+            struct BlockCacheEntry *blockEntry = GetDirectoryBlock(dirInode, path[level].block);
+            if (blockEntry == NULL) {
+                return ERROR;
+            }
+            if (IndexHeader(blockEntry->data, path[level].block)->count < IndexCapacity(path[level].block)) {
+                continue;
+            }
+            if (level == levels) {
+                split = (GrowIndexRoot(dirInodeEntry) == ERROR) ? ERROR : 1;
+            }
+            else {
+                split = (SplitIndexNode(dirInodeEntry, path, level) == ERROR) ? ERROR : 1;
+            }
+        }
+        if (split == ERROR) {
+            break;
+        }
+        if (split) {
+            continue;
+        }
+
+        struct BlockCacheEntry *blockEntry = GetDirectoryBlock(dirInode, leafBlock);
+        if (blockEntry == NULL) {
+            return ERROR;
+        }
+        struct dir_entry *entries = (struct dir_entry *)blockEntry->data;
+        for (int i = 0; i < DIRENTRY_PER_BLOCK; i++) {
+            if (entries[i].inum == 0) {
+                entries[i].inum = inum;
+                memset(entries[i].name, 0, DIRNAMELEN);
+                memcpy(entries[i].name, name, nameLen);
+                MarkBlockEntryDirty(blockEntry);
+                return 0;
+            }
+        }
+        if (SplitLeaf(dirInodeEntry, path, leafBlock) == ERROR) {
+            break;
+        }
+    }
+    return AddOverflowDirEntry(dirInode, inum, name, nameLen);
+}
+
+/**
+ * Remove an entry from an indexed directory. Leaves are not merged, the slot simply becomes free
+ * @param dirInodeEntry The inode cache entry of an indexed directory
+ * @param inum The inode number of the entry
+ * @param name The name of the entry
+ * @param nameLen The length of the name
+ * @return 0 on success, ERROR if the entry is not in its leaf
+ */
+int RemoveIndexedDirEntry(struct InodeCacheEntry *dirInodeEntry, int inum, char *name, int nameLen) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    int levels;
+    int leafBlock = FindLeaf(dirInode, DirNameHash(name, nameLen), NULL, &levels);
+    if (leafBlock == ERROR) {
+        return ERROR;
+    }
+    struct BlockCacheEntry *blockEntry = GetDirectoryBlock(dirInode, leafBlock);
+    if (blockEntry == NULL) {
+        return ERROR;
+    }
+    struct dir_entry *entries = (struct dir_entry *)blockEntry->data;
+    for (int i = 0; i < DIRENTRY_PER_BLOCK; i++) {
+        if (entries[i].inum == inum && DirEntryNameLen(&entries[i]) == nameLen && memcmp(entries[i].name, name, nameLen) == 0) {
+            entries[i].inum = 0;
+            memset(entries[i].name, 0, DIRNAMELEN);
+            MarkBlockEntryDirty(blockEntry);
+            return 0;
+        }
+    }
+    return ERROR;
+}
+
+/**
+ * Estimate how many blocks CompactIndexedDirectory packs an indexed directory into: leaves filled to
+ * DIR_COMPACT_LEAF_FILL and the index nodes above them. Runs of equal hashes can add a leaf now and then
+ * @param entryCount The number of live entries, not counting "." and ".."
+ * @return The estimated number of blocks, block 0 included
+ */
+int EstimateCompactedIndexBlocks(int entryCount) {
+    if (entryCount <= DIR_COMPACT_LINEAR_MAX) {
+        return 1;
+    }
+    int pairs = (entryCount + DIR_COMPACT_LEAF_FILL - 1) / DIR_COMPACT_LEAF_FILL;
+    int blocks = 1 + pairs;
+    int nodeFill = IndexCapacity(1) * DIR_COMPACT_LEAF_FILL / DIRENTRY_PER_BLOCK;
+    while (pairs > IndexCapacity(0)) {
+        pairs = (pairs + nodeFill - 1) / nodeFill;
+        blocks += pairs;
+    }
+    return blocks;
+}
+
+static int CompareCompactEntries(const void *a, const void *b) {
+    unsigned int hashA = ((const CompactEntry *)a)->hash;
+    unsigned int hashB = ((const CompactEntry *)b)->hash;
+    return (hashA > hashB) - (hashA < hashB);
+}
+
+/**
+ * Rebuild a sparse indexed directory into as few blocks as possible, leaving the blocks past the
+ * returned count unused for the caller to free. The live entries are packed by hash into leaves filled
+ * to DIR_COMPACT_LEAF_FILL so that the next few inserts do not split them again, and a new index is
+ * built bottom up over them. At most DIR_COMPACT_LINEAR_MAX entries go back next to "." and ".." and the
+ * directory becomes linear again. That leaves room for a couple of inserts before the block is full and the
+ * directory is indexed again, so creating and removing a name in turn does not convert it back and forth.
+ * Nothing is written unless the new layout takes fewer blocks than the current one
+ * @param dirInodeEntry The inode cache entry of an indexed directory
+ * @return The number of blocks the directory now uses, or ERROR if it was left unchanged
+ */
+int CompactIndexedDirectory(struct InodeCacheEntry *dirInodeEntry) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    int oldBlocks = dirInode->size / BLOCKSIZE;
+    char block[BLOCKSIZE];
+    CompactEntry *live = malloc(oldBlocks * DIRENTRY_PER_BLOCK * sizeof(CompactEntry));
+    if (live == NULL) {
+        return ERROR;
+    }
+
+    // Collect the live entries of every leaf
+    int count = 0;
+    for (int logicalBlock = 1; logicalBlock < oldBlocks; logicalBlock++) {
+        if (ReadDirectoryBlock(dirInode, logicalBlock, block) == ERROR) {
+            free(live);
+            return ERROR;
+        }
+        struct dir_index_header *header = IndexHeader(block, logicalBlock);
+        if (header->inum == 0 && header->magic == DIR_INDEX_MAGIC) {
+            continue;
+        }
+        struct dir_entry *entries = (struct dir_entry *)block;
+        for (int i = 0; i < DIRENTRY_PER_BLOCK; i++) {
+            if (entries[i].inum != 0) {
+                live[count].hash = DirNameHash(entries[i].name, DirEntryNameLen(&entries[i]));
+                live[count].entry = entries[i];
+                count++;
+            }
+        }
+    }
+    if (ReadDirectoryBlock(dirInode, 0, block) == ERROR) {
+        free(live);
+        return ERROR;
+    }
+
+    // Few enough entries to share block 0 with "." and "..", with room to spare
+    if (count <= DIR_COMPACT_LINEAR_MAX) {
+        TracePrintf(0, "CompactIndexedDirectory: Directory %d goes back to a single linear block with %d entries\n",
+            dirInodeEntry->inodeNumber, count);
+        struct dir_entry *entries = (struct dir_entry *)block;
+        memset(&entries[DIR_INDEX_ROOT_SLOT], 0, BLOCKSIZE - DIR_INDEX_ROOT_SLOT * sizeof(struct dir_entry));
+        for (int i = 0; i < count; i++) {
+            entries[DIR_INDEX_ROOT_SLOT + i] = live[i].entry;
+        }
+        free(live);
+        if (WriteDirectoryBlock(dirInode, 0, block) == ERROR) {
+            return ERROR;
+        }
+        return 1;
+    }
+
+    qsort(live, count, sizeof(CompactEntry), CompareCompactEntries);
+    char *image = calloc(oldBlocks, BLOCKSIZE);
+    unsigned int *pairHash = malloc(oldBlocks * sizeof(unsigned int));
+    int *pairBlock = malloc(oldBlocks * sizeof(int));
+    if (image == NULL || pairHash == NULL || pairBlock == NULL) {
+        free(live);
+        free(image);
+        free(pairHash);
+        free(pairBlock);
+        return ERROR;
+    }
+
+    // Pack the leaves, never splitting a run of equal hashes
+    int pairs = 0;
+    int newBlocks = 1;
+    int ok = 1;
+    for (int first = 0; first < count && ok; ) {
+        int end = (first + DIR_COMPACT_LEAF_FILL < count) ? first + DIR_COMPACT_LEAF_FILL : count;
+        while (end < count && end < first + DIRENTRY_PER_BLOCK && live[end].hash == live[end - 1].hash) {
+            end++;
+        }
+        while (end < count && end > first && live[end].hash == live[end - 1].hash) {
+            end--;
+        }
+        if (end == first || newBlocks >= oldBlocks) {
+            ok = 0;
+            break;
+        }
+        struct dir_entry *entries = (struct dir_entry *)(image + newBlocks * BLOCKSIZE);
+        for (int i = first; i < end; i++) {
+            entries[i - first] = live[i].entry;
+        }
+        pairHash[pairs] = (first == 0) ? 0 : live[first].hash;
+        pairBlock[pairs] = newBlocks;
+        pairs++;
+        newBlocks++;
+        first = end;
+    }
+
+    // Build the index bottom up until the top level fits into the root, spreading the pairs evenly over
+    // index nodes filled to the same share as the leaves so that later splits rarely need new index blocks
+    int levels = 1;
+    while (ok && pairs > IndexCapacity(0)) {
+        int nodeFill = IndexCapacity(1) * DIR_COMPACT_LEAF_FILL / DIRENTRY_PER_BLOCK;
+        int nodes = (pairs + nodeFill - 1) / nodeFill;
+        if (levels >= DIR_INDEX_MAX_LEVELS || newBlocks + nodes > oldBlocks) {
+            ok = 0;
+            break;
+        }
+        for (int n = 0; n < nodes; n++) {
+            int first = n * pairs / nodes;
+            int end = (n + 1) * pairs / nodes;
+            char *node = image + newBlocks * BLOCKSIZE;
+            struct dir_index_header *header = IndexHeader(node, newBlocks);
+            struct dir_index_slot *slots = IndexSlots(node, newBlocks);
+            header->magic = DIR_INDEX_MAGIC;
+            header->count = end - first;
+            for (int k = first; k < end; k++) {
+                SetIndexPair(slots, k - first, pairHash[k], pairBlock[k]);
+            }
+            // The pairs of node n are all read, and n <= first, so the next level can reuse the arrays
+            pairHash[n] = pairHash[first];
+            pairBlock[n] = newBlocks;
+            newBlocks++;
+        }
+        pairs = nodes;
+        levels++;
+    }
+    free(live);
+
+    if (!ok || newBlocks >= oldBlocks) {
+        TracePrintf(0, "CompactIndexedDirectory: Directory %d does not fit into fewer blocks\n", dirInodeEntry->inodeNumber);
+        free(image);
+        free(pairHash);
+        free(pairBlock);
+        return ERROR;
+    }
+    TracePrintf(0, "CompactIndexedDirectory: Packing %d entries of directory %d into %d blocks instead of %d\n",
+        count, dirInodeEntry->inodeNumber, newBlocks, oldBlocks);
+
+    // The root keeps "." and ".." from the current block 0
+    memcpy(image, block, DIR_INDEX_ROOT_SLOT * sizeof(struct dir_entry));
+    struct dir_index_header *rootHeader = IndexHeader(image, 0);
+    struct dir_index_slot *rootSlots = IndexSlots(image, 0);
+    rootHeader->magic = DIR_INDEX_MAGIC;
+    rootHeader->levels = levels;
+    rootHeader->count = pairs;
+    for (int k = 0; k < pairs; k++) {
+        SetIndexPair(rootSlots, k, pairHash[k], pairBlock[k]);
+    }
+    free(pairHash);
+    free(pairBlock);
+
+    for (int logicalBlock = 0; logicalBlock < newBlocks; logicalBlock++) {
+        if (WriteDirectoryBlock(dirInode, logicalBlock, image + logicalBlock * BLOCKSIZE) == ERROR) {
+            free(image);
+            return ERROR;
+        }
+    }
+    free(image);
+    return newBlocks;
+}
@@ -0,0 +1,60 @@
+#ifndef _DIRINDEX_H_
+#define _DIRINDEX_H_
+
+#include <comp421/yalnix.h>
+#include <comp421/filesystem.h>
+#include "../cache/cache.h"
+
+/**
+ * Indexed directories, selected at build time with -DDIRECTORY_INDEX (1 by default).
+ * A directory that outgrows its first block is converted into a hash tree: block 0 keeps "." and ".."
+ * and holds the root of the index, index blocks map ranges of name hashes to child blocks, and leaf
+ * blocks hold ordinary directory entries whose name hashes fall into their range.
+ * Every index slot overlays a struct dir_entry with inum 0, so code (and clients) scanning the
+ * directory linearly still sees every entry, and directories created before stay linear.
+ * When the index cannot grow any further (the directory reached the maximum file size or the disk is full),
+ * new entries go into any free slot of a leaf and lookups of names missing from their leaf fall back to a linear scan.
+ */
+#ifndef DIRECTORY_INDEX
+#define DIRECTORY_INDEX 1
+#endif
+
+#define DIR_INDEX_MAGIC 0x58444e49              // "INDX"
+#define DIR_INDEX_ROOT_SLOT 2                   // Slot of the index header in block 0, after "." and ".."
+#define DIR_INDEX_PAIRS_PER_SLOT 5
+#define DIR_INDEX_MAX_LEVELS 3
+#define DIR_INDEX_MAX_BLOCKS 65536              // Child block numbers are stored in 16 bits
+#define DIR_COMPACT_LEAF_FILL 12                // Entries per leaf when a directory is compacted, out of DIRENTRY_PER_BLOCK
+#define DIR_COMPACT_LINEAR_MAX 12               // Most names a compacted directory may have to go back to linear, below the 14 that fit
+
+/**
+ * Header of an index node, in slot DIR_INDEX_ROOT_SLOT of block 0 and in slot 0 of every other index block
+ */
+struct dir_index_header {
+    short inum;                                 // Always 0
+    short levels;                               // Root only: number of index levels above the leaves
+    int magic;
+    int count;                                  // Number of (hash, block) pairs in this node
+    int overflow;                               // Root only: set once an entry had to go outside its leaf
+    int unused[4];
+};
+
+/**
+ * Slot holding DIR_INDEX_PAIRS_PER_SLOT index pairs, sorted by hash across the node.
+ * Pair k covers the name hashes from hash[k] up to the next pair's hash
+ */
+struct dir_index_slot {
+    short inum;                                 // Always 0
+    unsigned short block[DIR_INDEX_PAIRS_PER_SLOT];
+    unsigned int hash[DIR_INDEX_PAIRS_PER_SLOT];
+};
+
+int IsIndexedDirectory(struct InodeCacheEntry *dirInodeEntry);
+int ConvertToIndexedDirectory(struct InodeCacheEntry *dirInodeEntry);
+int LookupIndexedDirectory(struct InodeCacheEntry *dirInodeEntry, char *name, int nameLen);
+int AddIndexedDirEntry(struct InodeCacheEntry *dirInodeEntry, int inum, char *name, int nameLen);
+int RemoveIndexedDirEntry(struct InodeCacheEntry *dirInodeEntry, int inum, char *name, int nameLen);
+int EstimateCompactedIndexBlocks(int entryCount);
+int CompactIndexedDirectory(struct InodeCacheEntry *dirInodeEntry);
+
+#endif /* _DIRINDEX_H_ */
@@ -0,0 +1,346 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freemap.h"
+
+uint64_t *freeBlocksMap;
+int freeBlocksCount;
+int freeBlocksPromised;
+long freeMapWordsScanned;
+
+static int freeBlocksMapWords;          // Number of 64-bit words in freeBlocksMap
+static int *freeBlocksRegionCount;      // Number of free blocks in each region
+static int freeBlocksRegions;
+static int freeBlocksCursor;            // Word the next search starts from (next-fit)
+
+int freeInodesCount;
+static int *freeInodesStack;            // Free inode numbers, the top of the stack is handed out next
+static char *freeInodesFlag;            // 1 if the inode is on freeInodesStack, 0 if it is used
+static int freeInodesMax;               // Number of inodes, not counting inode 0
+
+/**
+ * Allocate the free block bitmap with every block marked as free
+ * @param numBlocks The number of blocks in the file system
+ */
+void InitializeFreeBlockMap(int numBlocks) {
+    TracePrintf(0, "InitializeFreeBlockMap: Initializing bitmap for %d blocks\n", numBlocks);
+    freeBlocksMapWords = (numBlocks + FREE_MAP_WORD_BITS - 1) / FREE_MAP_WORD_BITS;
+    freeBlocksRegions = (freeBlocksMapWords + FREE_MAP_REGION_WORDS - 1) / FREE_MAP_REGION_WORDS;
+    free(freeBlocksMap);
+    free(freeBlocksRegionCount);
+    freeBlocksMap = malloc(sizeof(uint64_t) * freeBlocksMapWords);
+    freeBlocksRegionCount = malloc(sizeof(int) * freeBlocksRegions);
+
+    for (int i = 0; i < freeBlocksMapWords; i++) {
+        freeBlocksMap[i] = ~(uint64_t)0;
+    }
+    // Bits past the last block stay clear so they are never handed out
+    if (numBlocks % FREE_MAP_WORD_BITS != 0) {
+        freeBlocksMap[freeBlocksMapWords - 1] = ((uint64_t)1 << (numBlocks % FREE_MAP_WORD_BITS)) - 1;
+    }
+
+    int regionBlocks = FREE_MAP_REGION_WORDS * FREE_MAP_WORD_BITS;
+    for (int i = 0; i < freeBlocksRegions; i++) {
+        int regionEnd = (i + 1) * regionBlocks;
+        freeBlocksRegionCount[i] = ((regionEnd < numBlocks) ? regionEnd : numBlocks) - i * regionBlocks;
+    }
+
+    freeBlocksCount = numBlocks;
+    freeBlocksPromised = 0;
+    freeBlocksCursor = 0;
+    freeMapWordsScanned = 0;
+}
+
+/**
+ * Check whether a block is free
+ * @param blockNumber The block number to check
+ * @return 1 if the block is free, 0 otherwise
+ */
+int IsBlockFree(int blockNumber) {
+    return (freeBlocksMap[blockNumber / FREE_MAP_WORD_BITS] >> (blockNumber % FREE_MAP_WORD_BITS)) & 1;
+}
+
+/**
+ * Mark a block as used, nothing happens if it is already used
+ * @param blockNumber The block number to mark
+ */
+void MarkBlockUsed(int blockNumber) {
+    if (!IsBlockFree(blockNumber)) {
+        return;
+    }
+    freeBlocksMap[blockNumber / FREE_MAP_WORD_BITS] &= ~((uint64_t)1 << (blockNumber % FREE_MAP_WORD_BITS));
+    freeBlocksRegionCount[blockNumber / (FREE_MAP_WORD_BITS * FREE_MAP_REGION_WORDS)] -= 1;
+    freeBlocksCount -= 1;
+}
+
+/**
+ * Return a block to the free map, nothing happens if it is already free
+ * @param blockNumber The block number to free
+ */
+void FreeBlock(int blockNumber) {
+    if (IsBlockFree(blockNumber)) {
+        return;
+    }
+    freeBlocksMap[blockNumber / FREE_MAP_WORD_BITS] |= (uint64_t)1 << (blockNumber % FREE_MAP_WORD_BITS);
+    freeBlocksRegionCount[blockNumber / (FREE_MAP_WORD_BITS * FREE_MAP_REGION_WORDS)] += 1;
+    freeBlocksCount += 1;
+}
+
+/**
+ * Find a free block, searching next-fit from where the last search stopped.
+ * Full regions are skipped using their free counts, and a word with a free bit is resolved with count-trailing-zeros.
+ * The block is not marked as used
+ * @return The block number, or ERROR if no free blocks are available
+ */
+int FindFreeBlock() {
+    if (freeBlocksCount <= 0) {
+        return ERROR;
+    }
+    int word = freeBlocksCursor;
+    int visited = 0;
+    while (visited < freeBlocksMapWords) {
+        int region = word / FREE_MAP_REGION_WORDS;
+        if (freeBlocksRegionCount[region] == 0) {
+            // Skip the rest of a full region in one step
+            int next = (region + 1) * FREE_MAP_REGION_WORDS;
+            if (next > freeBlocksMapWords) {
+                next = freeBlocksMapWords;
+            }
+            visited += next - word;
+            word = (next == freeBlocksMapWords) ? 0 : next;
+            continue;
+        }
+        freeMapWordsScanned += 1;
+        if (freeBlocksMap[word] != 0) {
+            freeBlocksCursor = word;
+            return word * FREE_MAP_WORD_BITS + __builtin_ctzll(freeBlocksMap[word]);
+        }
+        visited += 1;
+        word = (word + 1 == freeBlocksMapWords) ? 0 : word + 1;
+    }
+    return ERROR;
+}
+
+/**
+ * Find a free block for a file, preferring the goal block and otherwise the start of the first run of
+ * runLength free blocks at or after it, so the file can keep growing in place from there.
+ * Without a goal the search starts where the last FindFreeBlock stopped. If no run that long is left
+ * anywhere, any free block will do. The block is not marked as used
+ * @param goal The block the file would ideally continue at, or 0 for none
+ * @param runLength The length of the free run to look for
+ * @return The block number, or ERROR if no free blocks are available
+ */
+int FindFreeBlockNear(int goal, int runLength) {
+    if (freeBlocksCount <= 0) {
+        return ERROR;
+    }
+    int totalBlocks = freeBlocksMapWords * FREE_MAP_WORD_BITS;
+    if (goal > 0 && goal < totalBlocks && IsBlockFree(goal)) {
+        return goal;
+    }
+    int regionBlocks = FREE_MAP_REGION_WORDS * FREE_MAP_WORD_BITS;
+    int block = (goal > 0 && goal < totalBlocks) ? goal : freeBlocksCursor * FREE_MAP_WORD_BITS;
+    int visited = 0;
+    while (visited < totalBlocks) {
+        int next;
+        uint64_t bits = freeBlocksMap[block / FREE_MAP_WORD_BITS] >> (block % FREE_MAP_WORD_BITS);
+        if (freeBlocksRegionCount[block / regionBlocks] == 0) {
+            // Skip the rest of a full region in one step
+            next = (block / regionBlocks + 1) * regionBlocks;
+        }
+        else if (bits == 0) {
+            freeMapWordsScanned += 1;
+            next = (block / FREE_MAP_WORD_BITS + 1) * FREE_MAP_WORD_BITS;
+        }
+        else {
+            freeMapWordsScanned += 1;
+            int start = block + __builtin_ctzll(bits);
+            int length = 1;
+            while (length < runLength && start + length < totalBlocks && IsBlockFree(start + length)) {
+                length++;
+            }
+            if (length == runLength) {
+                return start;
+            }
+            next = start + length;
+        }
+        if (next > totalBlocks) {
+            next = totalBlocks;
+        }
+        visited += next - block;
+        block = (next == totalBlocks) ? 0 : next;
+    }
+    return FindFreeBlock();
+}
+
+/**
+ * Mark the free blocks starting at a block as used, stopping at the first block that is not free
+ * @param start The first block
+ * @param maxCount The most blocks to take
+ * @return The number of blocks taken
+ */
+int TakeFreeRun(int start, int maxCount) {
+    int count = 0;
+    while (count < maxCount && start + count < freeBlocksMapWords * FREE_MAP_WORD_BITS && IsBlockFree(start + count)) {
+        MarkBlockUsed(start + count);
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Find a run of consecutive free blocks, searching down from the end of the disk.
+ * The blocks are not marked as used
+ * @param count The number of blocks needed
+ * @return The first block of the run, or ERROR if there is no such run
+ */
+int FindFreeRun(int count) {
+    int runLength = 0;
+    for (int i = freeBlocksMapWords * FREE_MAP_WORD_BITS - 1; i > 0; i--) {
+        runLength = IsBlockFree(i) ? runLength + 1 : 0;
+        if (runLength == count) {
+            return i;
+        }
+    }
+    return ERROR;
+}
+
+/**
+ * Print the free map counters
+ */
+void PrintFreeMapStats() {
+    TracePrintf(0, "PrintFreeMapStats: %d free blocks, %ld bitmap words scanned by allocation\n",
+        freeBlocksCount, freeMapWordsScanned);
+}
+
+/**
+ * Allocate the free inode stack with every inode marked as used
+ * @param numInodes The number of inodes in the file system, not counting inode 0
+ */
+void InitializeFreeInodeMap(int numInodes) {
+    TracePrintf(0, "InitializeFreeInodeMap: Initializing free stack for %d inodes\n", numInodes);
+    free(freeInodesStack);
+    free(freeInodesFlag);
+    freeInodesMax = numInodes;
+    freeInodesStack = malloc(sizeof(int) * (numInodes + 1));
+    freeInodesFlag = calloc(numInodes + 1, sizeof(char));
+    freeInodesCount = 0;
+}
+
+/**
+ * Check whether an inode is free
+ * @param inodeNumber The inode number to check
+ * @return 1 if the inode is free, 0 otherwise
+ */
+int IsInodeFree(int inodeNumber) {
+    return freeInodesFlag[inodeNumber];
+}
+
+/**
+ * Push an inode onto the free stack, nothing happens if it is already free
+ * @param inodeNumber The inode number to free
+ */
+void FreeInode(int inodeNumber) {
+    if (freeInodesFlag[inodeNumber]) {
+        return;
+    }
+    freeInodesStack[freeInodesCount] = inodeNumber;
+    freeInodesFlag[inodeNumber] = 1;
+    freeInodesCount += 1;
+}
+
+/**
+ * Pop a free inode off the stack and mark it as used
+ * @return The inode number, or ERROR if no free inodes are available
+ */
+int TakeFreeInode() {
+    if (freeInodesCount <= 0) {
+        return ERROR;
+    }
+    int inodeNumber = freeInodesStack[freeInodesCount - 1];
+    freeInodesFlag[inodeNumber] = 0;
+    freeInodesCount -= 1;
+    return inodeNumber;
+}
+
+/**
+ * Number of inode bitmap words in a checkpoint
+ */
+static int CheckpointInodeWords() {
+    return (freeInodesMax + 1 + FREE_MAP_WORD_BITS - 1) / FREE_MAP_WORD_BITS;
+}
+
+/**
+ * Number of blocks a checkpoint of the free maps takes: the block bitmap followed by a free inode bitmap
+ * @return The number of blocks
+ */
+int FreeMapCheckpointBlocks() {
+    int bytes = (freeBlocksMapWords + CheckpointInodeWords()) * sizeof(uint64_t);
+    return (bytes + BLOCKSIZE - 1) / BLOCKSIZE;
+}
+
+/**
+ * Write the free maps to consecutive blocks on disk, bypassing the block cache
+ * @param startBlock The first block of the checkpoint area
+ * @return 0 on success, ERROR on failure
+ */
+int SaveFreeMapCheckpoint(int startBlock) {
+    int blocks = FreeMapCheckpointBlocks();
+    uint64_t *buf = calloc(blocks, BLOCKSIZE);
+    memcpy(buf, freeBlocksMap, freeBlocksMapWords * sizeof(uint64_t));
+    uint64_t *inodeBits = buf + freeBlocksMapWords;
+    for (int i = 1; i <= freeInodesMax; i++) {
+        if (IsInodeFree(i)) {
+            inodeBits[i / FREE_MAP_WORD_BITS] |= (uint64_t)1 << (i % FREE_MAP_WORD_BITS);
+        }
+    }
+    int result = 0;
+    for (int i = 0; i < blocks; i++) {
+        if (WriteSector(startBlock + i, (char *)buf + i * BLOCKSIZE) == ERROR) {
+            result = ERROR;
+            break;
+        }
+    }
+    free(buf);
+    return result;
+}
+
+/**
+ * Load the free maps from a checkpoint written by SaveFreeMapCheckpoint.
+ * InitializeFreeBlockMap and InitializeFreeInodeMap must have been called for the same file system
+ * @param startBlock The first block of the checkpoint area
+ * @return 0 on success, ERROR on failure
+ */
+int LoadFreeMapCheckpoint(int startBlock) {
+    int blocks = FreeMapCheckpointBlocks();
+    uint64_t *buf = malloc(blocks * BLOCKSIZE);
+    for (int i = 0; i < blocks; i++) {
+        if (ReadSector(startBlock + i, (char *)buf + i * BLOCKSIZE) == ERROR) {
+            free(buf);
+            return ERROR;
+        }
+    }
+
+    // The freshly initialized map has exactly the valid block bits set, so masking with it drops any bit past the last block
+    for (int i = 0; i < freeBlocksMapWords; i++) {
+        freeBlocksMap[i] &= buf[i];
+    }
+    freeBlocksCount = 0;
+    for (int r = 0; r < freeBlocksRegions; r++) {
+        freeBlocksRegionCount[r] = 0;
+        for (int i = r * FREE_MAP_REGION_WORDS; i < (r + 1) * FREE_MAP_REGION_WORDS && i < freeBlocksMapWords; i++) {
+            freeBlocksRegionCount[r] += __builtin_popcountll(freeBlocksMap[i]);
+        }
+        freeBlocksCount += freeBlocksRegionCount[r];
+    }
+
+    // Push in descending order so that the lowest free inode is handed out first
+    uint64_t *inodeBits = buf + freeBlocksMapWords;
+    for (int i = freeInodesMax; i >= 1; i--) {
+        if ((inodeBits[i / FREE_MAP_WORD_BITS] >> (i % FREE_MAP_WORD_BITS)) & 1) {
+            FreeInode(i);
+        }
+    }
+
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef _FREEMAP_H_
+#define _FREEMAP_H_
+
+#include <stdint.h>
+#include <comp421/yalnix.h>
+#include <comp421/filesystem.h>
+
+/**
+ * Free block bitmap, one bit per block, 1 for free and 0 for used.
+ * The bitmap is scanned a 64-bit word at a time, and it is split into regions of
+ * FREE_MAP_REGION_WORDS words whose free counts let a full region be skipped in one step.
+ */
+#define FREE_MAP_WORD_BITS 64
+#define FREE_MAP_REGION_WORDS 8         // 512 blocks per region
+
+extern uint64_t *freeBlocksMap;
+extern int freeBlocksCount;             // Number of free blocks available
+extern int freeBlocksPromised;          // Of those, blocks promised to delayed allocations, no one else may take them
+extern long freeMapWordsScanned;        // Bitmap words examined by FindFreeBlock, printed on Shutdown
+
+void InitializeFreeBlockMap(int numBlocks);
+int IsBlockFree(int blockNumber);
+void MarkBlockUsed(int blockNumber);
+void FreeBlock(int blockNumber);
+int FindFreeBlock();
+int FindFreeBlockNear(int goal, int runLength);
+int TakeFreeRun(int start, int maxCount);
+int FindFreeRun(int count);
+void PrintFreeMapStats();
+
+/**
+ * Free inodes, kept on a stack so that allocating and freeing an inode are O(1).
+ * A flag per inode tells whether it is on the stack, so freeing an inode twice is harmless.
+ */
+extern int freeInodesCount;             // Number of free inodes available
+
+void InitializeFreeInodeMap(int numInodes);
+int IsInodeFree(int inodeNumber);
+void FreeInode(int inodeNumber);
+int TakeFreeInode();
+
+/**
+ * Checkpoint of both free maps, written to reserved blocks on a clean shutdown so that the
+ * next mount can load it instead of scanning the inode table
+ */
+int FreeMapCheckpointBlocks();
+int SaveFreeMapCheckpoint(int startBlock);
+int LoadFreeMapCheckpoint(int startBlock);
+
+#endif /* _FREEMAP_H_ */
@@ -0,0 +1,164 @@
+#include <string.h>
+#include "namecache.h"
+
+int nameCacheHits;
+int nameCacheMisses;
+
+static NameCacheEntry nameCacheArena[NAME_CACHE_SIZE];
+static NameCacheEntry *nameCacheHash[NAME_CACHE_BUCKETS];
+static NameCacheEntry *nameCacheLruHead;
+static NameCacheEntry *nameCacheLruTail;
+
+/**
+ * Initialize the name cache, every slot starts empty (parentInum 0) on the LRU list
+ */
+void InitializeNameCache() {
+    nameCacheHits = 0;
+    nameCacheMisses = 0;
+    for (int i = 0; i < NAME_CACHE_BUCKETS; i++) {
+        nameCacheHash[i] = NULL;
+    }
+    nameCacheLruHead = NULL;
+    nameCacheLruTail = NULL;
+    for (int i = NAME_CACHE_SIZE - 1; i >= 0; i--) {
+        NameCacheEntry *entry = &nameCacheArena[i];
+        memset(entry, 0, sizeof(NameCacheEntry));
+        entry->lruNext = nameCacheLruHead;
+        if (nameCacheLruHead != NULL) {
+            nameCacheLruHead->lruPrev = entry;
+        }
+        else {
+            nameCacheLruTail = entry;
+        }
+        nameCacheLruHead = entry;
+    }
+}
+
+/**
+ * FNV-1a hash of the parent inode number and the component name
+ * @return The bucket index
+ */
+static int NameCacheBucket(int parentInum, char *name, int nameLen) {
+    unsigned int hash = 2166136261u ^ (unsigned int)parentInum;
+    hash *= 16777619u;
+    for (int i = 0; i < nameLen; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash % NAME_CACHE_BUCKETS;
+}
+
+/**
+ * Find the entry for a name, ignoring the parent reuse count
+ * @return The entry, or NULL if the name is not cached
+ */
+static NameCacheEntry *FindNameCacheEntry(int bucket, int parentInum, char *name, int nameLen) {
+    for (NameCacheEntry *entry = nameCacheHash[bucket]; entry != NULL; entry = entry->hashNext) {
+        if (entry->parentInum == parentInum && entry->nameLen == nameLen && memcmp(entry->name, name, nameLen) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Move an entry to the head of the LRU list
+ */
+static void TouchNameCacheEntry(NameCacheEntry *entry) {
+    if (entry == nameCacheLruHead) {
+        return;
+    }
+    entry->lruPrev->lruNext = entry->lruNext;
+    if (entry->lruNext != NULL) {
+        entry->lruNext->lruPrev = entry->lruPrev;
+    }
+    else {
+        nameCacheLruTail = entry->lruPrev;
+    }
+    entry->lruPrev = NULL;
+    entry->lruNext = nameCacheLruHead;
+    nameCacheLruHead->lruPrev = entry;
+    nameCacheLruHead = entry;
+}
+
+/**
+ * Take an entry out of its hash chain, the slot stays on the LRU list
+ */
+static void UnhashNameCacheEntry(NameCacheEntry *entry, int bucket) {
+    if (entry->hashPrev != NULL) {
+        entry->hashPrev->hashNext = entry->hashNext;
+    }
+    else {
+        nameCacheHash[bucket] = entry->hashNext;
+    }
+    if (entry->hashNext != NULL) {
+        entry->hashNext->hashPrev = entry->hashPrev;
+    }
+    entry->hashPrev = NULL;
+    entry->hashNext = NULL;
+}
+
+/**
+ * Look up a component name in the name cache
+ * @param parentInum The inode number of the parent directory
+ * @param parentReuse The current reuse count of the parent directory
+ * @param name The component name, not necessarily null terminated
+ * @param nameLen The length of the component name
+ * @return The inode number of the child, 0 if the name is known not to exist, or NAME_CACHE_MISS
+ */
+int LookupNameCache(int parentInum, int parentReuse, char *name, int nameLen) {
+    if (nameLen > DIRNAMELEN) {
+        return NAME_CACHE_MISS;
+    }
+    int bucket = NameCacheBucket(parentInum, name, nameLen);
+    NameCacheEntry *entry = FindNameCacheEntry(bucket, parentInum, name, nameLen);
+    if (entry == NULL || entry->parentReuse != parentReuse) {
+        // An entry left over from an earlier incarnation of the directory is stale
+        nameCacheMisses += 1;
+        return NAME_CACHE_MISS;
+    }
+    TouchNameCacheEntry(entry);
+    nameCacheHits += 1;
+    return entry->inum;
+}
+
+/**
+ * Record the result of a lookup or a directory change in the name cache, replacing any previous entry for the name
+ * @param parentInum The inode number of the parent directory
+ * @param parentReuse The current reuse count of the parent directory
+ * @param name The component name, not necessarily null terminated
+ * @param nameLen The length of the component name
+ * @param inum The inode number of the child, or 0 if the name does not exist in the directory
+ */
+void EnterNameCache(int parentInum, int parentReuse, char *name, int nameLen, int inum) {
+    if (nameLen > DIRNAMELEN) {
+        return;
+    }
+    int bucket = NameCacheBucket(parentInum, name, nameLen);
+    NameCacheEntry *entry = FindNameCacheEntry(bucket, parentInum, name, nameLen);
+    if (entry == NULL) {
+        // Recycle the least recently used slot
+        entry = nameCacheLruTail;
+        if (entry->parentInum != 0) {
+            UnhashNameCacheEntry(entry, NameCacheBucket(entry->parentInum, entry->name, entry->nameLen));
+        }
+        entry->parentInum = parentInum;
+        entry->nameLen = nameLen;
+        memcpy(entry->name, name, nameLen);
+        entry->hashNext = nameCacheHash[bucket];
+        if (entry->hashNext != NULL) {
+            entry->hashNext->hashPrev = entry;
+        }
+        nameCacheHash[bucket] = entry;
+    }
+    entry->parentReuse = parentReuse;
+    entry->inum = inum;
+    TouchNameCacheEntry(entry);
+}
+
+/**
+ * Print the name cache counters
+ */
+void PrintNameCacheStats() {
+    TracePrintf(0, "PrintNameCacheStats: %d hits, %d misses\n", nameCacheHits, nameCacheMisses);
+}
@@ -0,0 +1,36 @@
+#ifndef _NAMECACHE_H_
+#define _NAMECACHE_H_
+
+#include <comp421/yalnix.h>
+#include <comp421/filesystem.h>
+
+/**
+ * Directory name lookup cache, mapping (parent directory inum, component name) to the child inum.
+ * A negative entry (inum 0) records a name known not to exist in the directory.
+ * Entries also remember the reuse count of the parent, so they die with it when the inode is reused.
+ */
+#define NAME_CACHE_SIZE 256                 // Number of cached names
+#define NAME_CACHE_BUCKETS 128
+#define NAME_CACHE_MISS (-2)                // LookupNameCache result when the name is not cached
+
+typedef struct NameCacheEntry {
+    int parentInum;
+    int parentReuse;
+    int inum;                               // 0 for a negative entry
+    int nameLen;
+    char name[DIRNAMELEN];
+    struct NameCacheEntry *lruPrev;
+    struct NameCacheEntry *lruNext;
+    struct NameCacheEntry *hashPrev;
+    struct NameCacheEntry *hashNext;
+} NameCacheEntry;
+
+extern int nameCacheHits;
+extern int nameCacheMisses;
+
+void InitializeNameCache();
+int LookupNameCache(int parentInum, int parentReuse, char *name, int nameLen);
+void EnterNameCache(int parentInum, int parentReuse, char *name, int nameLen, int inum);
+void PrintNameCacheStats();
+
+#endif /* _NAMECACHE_H_ */
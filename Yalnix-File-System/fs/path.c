@@ -5,10 +5,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "path.h"
+#include "namecache.h"
+#include "dirindex.h"
+#include "blockmap.h"
 #include "../cache/cache.h"
 
 /**
- * Parse the given pathname from directory inum
+ * Parse the given pathname from directory inum.
+ * Components are taken in place from the pathname as (pointer, length) pairs, nothing is copied
  * @param pathname The pathname to parse
  * @param inum The inode number of the directory to start from
  * @param symlinkDepth The depth of the symbolic link resolution, should not exceed MAXSYMLINKS
@@ -28,156 +32,134 @@ int resolvePath(char *pathname, int inum, int symlinkDepth, int resolveLastSymLi
 
     // Start with the current working directory
     int currentDir = (pathname[0] == '/') ? ROOTINODE : inum;
-    int currentInode;
+    int currentInode = currentDir;
 
-    int index = 0;
-    char* componentName = NULL;
-    
     // Get the first component of the pathname
-    index = GetComponent(pathname, &componentName, index);
+    int componentLength;
+    int componentStart = GetComponent(pathname, 0, &componentLength);
 
     // Resolve each component of the pathname
-    while (componentName != NULL) {
+    while (componentLength > 0) {
+        char *componentName = pathname + componentStart;
+
         // Get current dir
         struct InodeCacheEntry* currentDirEntry = GetInodeFromCache(currentDir);
         if (currentDirEntry == NULL) {
-            free(componentName);
             return ERROR;
         }
-        
-        struct inode* dirInodeInfo = GetInodeFromCache(currentDir)->inodeInfo;
-        TracePrintf(0, "resolvePath: componentName is %s, currentDir is type %d\n", componentName, dirInodeInfo->type);
-        
-        // If the current dir is a regular file and there are more components to resolve
-        if ((dirInodeInfo->type == INODE_FREE) || (dirInodeInfo->type == INODE_REGULAR)) {
-            TracePrintf(0, "resolvePath: dirInode is INODE_FREE or INODE_REGULAR, returning ERROR\n");
-            free(componentName);
+        struct inode* dirInodeInfo = currentDirEntry->inodeInfo;
+        TracePrintf(0, "resolvePath: componentName is %.*s, currentDir is type %d\n", componentLength, componentName, dirInodeInfo->type);
+
+        // Only a directory can have more components to resolve
+        if (dirInodeInfo->type != INODE_DIRECTORY) {
+            TracePrintf(0, "resolvePath: dirInode is not INODE_DIRECTORY, returning ERROR\n");
             return ERROR;
         }
 
-        // If the current dir is a directory, we need to get the inode number of the component
-        if (dirInodeInfo->type == INODE_DIRECTORY) {
-            // Get the child component's inode number from the directory
-            TracePrintf(0, "resolvePath: dirInodeInfo is INODE_DIRECTORY, doing GetInumByComponentName\n");
-            currentInode = GetInumByComponentName(currentDirEntry, componentName);
+        // Get the child component's inode number from the directory
+        currentInode = GetInumByComponent(currentDirEntry, componentName, componentLength);
+        if (currentInode == ERROR || currentInode == 0) {
+            TracePrintf(0, "resolvePath: GetInumByComponent returned ERROR or 0\n");
+            return ERROR;
+        }
 
-            if (currentInode == ERROR || currentInode == 0) {
-                TracePrintf(0, "resolvePath: GetInumByComponentName returned ERROR or 0\n");
-                free(componentName);
-                return ERROR;
+        struct InodeCacheEntry *currentInodeEntry = GetInodeFromCache(currentInode);
+        if (currentInodeEntry == NULL) {
+            TracePrintf(0, "resolvePath: currentInodeEntry is NULL\n");
+            return ERROR;
+        }
+        struct inode* inodeInfo = currentInodeEntry->inodeInfo;
+
+        // Get the next component of the pathname
+        componentStart = GetComponent(pathname, componentStart + componentLength, &componentLength);
+
+        if (inodeInfo->type == INODE_SYMLINK) {
+            // If the last component of the pathname is the name of a symbolic link,
+            // then that symbolic link must not be traversed unless the pathname is being looked up
+            // for an Open, Create, or ChDir file system operation
+            if (componentLength == 0 && !resolveLastSymLink) {
+                TracePrintf(0, "resolvePath: last component is INODE_SYMLINK, not resolving symlink\n");
+                return currentInode;
             }
-
-            struct InodeCacheEntry *currentInodeEntry = GetInodeFromCache(currentInode);
-            if (currentInodeEntry == NULL) {
-                TracePrintf(0, "resolvePath: currentInodeEntry is NULL\n");
-                free(componentName);
+            TracePrintf(0, "resolvePath: currentInode is INODE_SYMLINK, resolving symlink\n");
+            currentInode = ResolveSymbolicLink(currentDir, inodeInfo, symlinkDepth + 1);
+            if (currentInode == ERROR) {
                 return ERROR;
             }
-            struct inode* inodeInfo = currentInodeEntry->inodeInfo;
-
-            // Check if we get an INODE_SYMLINK
-            if (inodeInfo->type == INODE_SYMLINK) {
-                // Get the next component of the pathname
-                free(componentName);
-                componentName = NULL;
-                index = GetComponent(pathname, &componentName, index);
-
-                // This is the last component of the path name
-                // If the last component of the pathname is the name of a symbolic link, 
-                // then that symbolic link must not be traversed unless the pathname is being looked up
-                // for an Open, Create, or ChDir file system operation
-                if (componentName == NULL) {
-                    free(componentName);
-                    // This is the last component of the path name and resolveLastSymLink is 1
-                    // So we need to resolve the symbolic link
-                    if (resolveLastSymLink) {
-                        // Get inode number from symbolic link recursively
-                        TracePrintf(0, "resolvePath: currentInode is INODE_SYMLINK, resolveLastSymLink is %d, resolving symlink\n", resolveLastSymLink);
-                        currentInode = ResolveSymbolicLink(currentDir, inodeInfo, symlinkDepth + 1);
-                        if (currentInode == ERROR) {
-                            free(componentName);
-                            return ERROR;
-                        }
-                        // “cd” into the link’s target before moving on
-                        currentDir = currentInode;
-                        return currentInode;
-                    }
-                    // This is the last component of the path name but resolveLastSymLink is 0 
-                    // We simply return the inum of the INODE_SYMLINK
-                    else {
-                        TracePrintf(0, "resolvePath: currentInode is INODE_SYMLINK, resolveLastSymLink is %d, not resolving symlink\n", resolveLastSymLink);
-                        return currentInode;
-                    }
-                }
-                // If the next component is not NULL, we need to resolve it
-                else {
-                    TracePrintf(0, "resolvePath: currentInode is INODE_SYMLINK and next component is not NULL, continue resolving\n");
-                    currentInode = ResolveSymbolicLink(currentDir, inodeInfo, symlinkDepth + 1);
-                }
-            }
-            // If we get either a regular file or a directory, then we proceed to the next component
-            // Get the next component of the pathname
-            else {
-                TracePrintf(0, "resolvePath: currentInode not INODE_SYMLINK, getting next component\n");
-                currentDir = currentInode;
-                free(componentName);
-                componentName = NULL;
-                index = GetComponent(pathname, &componentName, index);
-            }
         }
+        // “cd” into the component (or the link’s target) before moving on
+        currentDir = currentInode;
     }
 
-    TracePrintf(0, "resolvePath: Finished resolving pathname, componentName is %s currentInode is %d\n", componentName, currentInode);
-    free(componentName);
+    TracePrintf(0, "resolvePath: Finished resolving pathname, currentInode is %d\n", currentInode);
     return currentInode;
 }
 
 /**
- * Get the next component of the pathname starting from the given index
+ * Find the next component of the pathname starting from the given index, the component is not copied
  * @param pathname The pathname to parse
- * @param componentName The name of the component to be filled
  * @param index The index to start from
- * @return The index of the next component to start from
+ * @param componentLength Set to the length of the component, 0 if there are no more components
+ * @return The index of the first character of the component in pathname
  */
-int GetComponent(char *pathname, char **componentName, int index) {
-    TracePrintf(0, "GetComponent: Parsing component from pathname %s at index %d\n", pathname, index);
+int GetComponent(char *pathname, int index, int *componentLength) {
     // Skip leading slashes
     while (pathname[index] == '/') {
         index += 1;
     }
 
     // Find the end of the component
-    int startIndex = index;
-    while (pathname[index] != '/' && pathname[index] != '\0') {
-        index += 1;
-    }
     int endIndex = index;
-
-    // Copy the component name
-    int componentLength = endIndex - startIndex;
-    if (componentLength > 0) {
-        *componentName = (char*)calloc(componentLength + 1, sizeof(char));   // Plus one for the null terminator
-        memcpy(*componentName, pathname + startIndex, componentLength);
-    } else {
-        *componentName = NULL;
+    while (pathname[endIndex] != '/' && pathname[endIndex] != '\0') {
+        endIndex += 1;
     }
+    *componentLength = endIndex - index;
 
-    TracePrintf(0, "GetComponent: componentName is now %s, index is now %d\n", *componentName, index);
+    TracePrintf(0, "GetComponent: component is %.*s at index %d\n", *componentLength, pathname + index, index);
     return index;
 }
 
 /**
- * Get the inode number of the component name in the directory
- * @param parentInode The parent inode to search in
+ * Get the inode number of the null terminated component name in the directory
+ * @param parentInodeEntry The inode cache entry of the parent to search in
  * @param componentName The name of the component to search for
- * @return The inode number of the component, or 0 if not found
+ * @return The inode number of the component, 0 if not found, or ERROR if the parent is not a directory
  */
 int GetInumByComponentName(struct InodeCacheEntry *parentInodeEntry, char *componentName) {
-    TracePrintf(0, "GetInumByComponentName: Searching for component %s in parent %d\n", componentName, parentInodeEntry->inodeNumber);
+    return GetInumByComponent(parentInodeEntry, componentName, strlen(componentName));
+}
+
+/**
+ * Get the inode number of a component in the directory
+ * @param parentInodeEntry The inode cache entry of the parent to search in
+ * @param componentName The name of the component, not necessarily null terminated
+ * @param componentLen The length of the component name
+ * @return The inode number of the component, 0 if not found, or ERROR if the parent is not a directory
+ */
+int GetInumByComponent(struct InodeCacheEntry *parentInodeEntry, char *componentName, int componentLen) {
+    TracePrintf(0, "GetInumByComponent: Searching for component %.*s in parent %d\n", componentLen, componentName, parentInodeEntry->inodeNumber);
     struct inode *parentInode = parentInodeEntry->inodeInfo;
     if (parentInode->type != INODE_DIRECTORY) {
         return ERROR;
     }
+    if (componentLen > DIRNAMELEN) {
+        return 0;
+    }
+
+    // Most lookups are answered by the name cache without touching the directory blocks
+    int cachedInum = LookupNameCache(parentInodeEntry->inodeNumber, parentInode->reuse, componentName, componentLen);
+    if (cachedInum != NAME_CACHE_MISS) {
+        return cachedInum;
+    }
+
+    // An indexed directory only needs the leaf covering the name, a damaged index falls back to the linear scan
+    if (IsIndexedDirectory(parentInodeEntry)) {
+        int inum = LookupIndexedDirectory(parentInodeEntry, componentName, componentLen);
+        if (inum != ERROR) {
+            EnterNameCache(parentInodeEntry->inodeNumber, parentInode->reuse, componentName, componentLen, inum);
+            return inum;
+        }
+    }
 
     int totalDirEntries = parentInode->size / sizeof(struct dir_entry);
     TracePrintf(0, "GetInumByComponentName: Total directory entries %d\n", totalDirEntries);
@@ -203,18 +185,20 @@ int GetInumByComponentName(struct InodeCacheEntry *parentInodeEntry, char *compo
         void *blockData = GetBlockFromCache(blockNumber)->data;
         struct dir_entry *dirEntry = (struct dir_entry *)(blockData + (i % DIRENTRY_PER_BLOCK) * sizeof(struct dir_entry));
         if (dirEntry->inum > 0) {
-            TracePrintf(0, "GetInumByComponentName: Entry %d - comparing %s with %s\n", i, dirEntry->name, componentName);
-            size_t dirEntryNameLen = 0;
+            TracePrintf(0, "GetInumByComponent: Entry %d - comparing %.*s with %.*s\n", i, DIRNAMELEN, dirEntry->name, componentLen, componentName);
+            int dirEntryNameLen = 0;
             while (dirEntryNameLen < DIRNAMELEN && dirEntry->name[dirEntryNameLen] != '\0') {
                 dirEntryNameLen++;
             }
-            if ((memcmp(dirEntry->name, componentName, strlen(componentName)) == 0) && (dirEntryNameLen == strlen(componentName))) {
+            if ((memcmp(dirEntry->name, componentName, componentLen) == 0) && (dirEntryNameLen == componentLen)) {
+                EnterNameCache(parentInodeEntry->inodeNumber, parentInode->reuse, componentName, componentLen, dirEntry->inum);
                 return dirEntry->inum;
             }
         }
     }
-    // If the component name is not found, return 0
-    TracePrintf(0, "GetInumByComponentName: Component %s not found\n", componentName);
+    // If the component name is not found, remember that and return 0
+    TracePrintf(0, "GetInumByComponent: Component %.*s not found\n", componentLen, componentName);
+    EnterNameCache(parentInodeEntry->inodeNumber, parentInode->reuse, componentName, componentLen, 0);
     return 0;
 }
 
@@ -235,6 +219,32 @@ int GetDataBlockNumberFromIndirectBlock(int indirectBlockNum, int index) {
     return ((int*)blockData)[index];
 }
 
+/**
+ * Copy the target of a symbolic link into a buffer
+ * @param inodeInfo The inode of the symbolic link
+ * @param target Buffer of at least MAXPATHNAMELEN + 1 bytes, filled with the null terminated target
+ * @return 0 on success, ERROR on failure
+ */
+static int ReadSymbolicLinkTarget(struct inode *inodeInfo, char *target) {
+    int targetLength = (inodeInfo->size < MAXPATHNAMELEN) ? inodeInfo->size : MAXPATHNAMELEN;
+    // A short target is stored inline, without a block
+    if (HasInlineData(inodeInfo)) {
+        if (targetLength > INLINE_DATA_SIZE) {
+            targetLength = INLINE_DATA_SIZE;
+        }
+        memcpy(target, GetInlineData(inodeInfo), targetLength);
+        target[targetLength] = '\0';
+        return 0;
+    }
+    struct BlockCacheEntry *blockEntry = GetBlockFromCache(inodeInfo->direct[0]);
+    if (blockEntry == NULL) {
+        return ERROR;
+    }
+    memcpy(target, blockEntry->data, targetLength);
+    target[targetLength] = '\0';
+    return 0;
+}
+
 /**
  * Resolve the symbolic link to get the inode number
  * @param inum The directory where the symbolic link is found
@@ -250,21 +260,20 @@ int ResolveSymbolicLink(int inum, struct inode *inodeInfo, int symlinkDepth) {
     }
 
     // Read the symbolic link data
-    // Since MAXPATHNAMELEN <= BLOCKSIZE, the entire symbolic link data can fit in one block at direct[0] (Slide p.7)
-    void *blockData = GetBlockFromCache(inodeInfo->direct[0])->data;
-    char *newPathName = calloc(inodeInfo->size + 1, sizeof(char));
-    memcpy(newPathName, blockData, inodeInfo->size);
+    // Since MAXPATHNAMELEN <= BLOCKSIZE, the entire symbolic link data fits inline or in one block at direct[0] (Slide p.7)
+    // The target is copied to the stack, resolving it goes through the block cache and may evict the block
+    char newPathName[MAXPATHNAMELEN + 1];
+    if (ReadSymbolicLinkTarget(inodeInfo, newPathName) == ERROR) {
+        return ERROR;
+    }
     TracePrintf(0, "ResolveSymbolicLink: Link target is '%s'\n", newPathName);
 
+    // Resolve the new pathname recursively
     int result = resolvePath(newPathName, inum, symlinkDepth + 1, 1);
     if (result == ERROR) {
         TracePrintf(0, "ResolveSymbolicLink: Error resolving symbolic link\n");
-        free(newPathName);
         return ERROR;
     }
-
-    // Resolve the new pathname recursively
-    free(newPathName);
     return result;
 }
 
@@ -311,160 +320,33 @@ static void TrimTrailingSlashes(char *path) {
     }
 }
 
-/**
- * Extracts the last component (filename or directory name) from a path
- * @param pathname Source path to parse
- * @param component Buffer to store the extracted component (must be pre-allocated)
- * @return 0 on success, ERROR if component name exceeds maximum length
- */
-static int ExtractLastComponent(char *pathname, char *component) {
-    if (pathname == NULL || component == NULL) {
-        return ERROR;  // Safety check for null pointers
-    }
-
-    // Start from the end of the pathname and move backwards to find the last slash
-    char *end = pathname + strlen(pathname);
-    char *lastSlash = NULL;
-
-    while (end != pathname) {
-        --end;
-        if (*end == '/') {
-            lastSlash = end;
-            break;
-        }
-    }
-
-    // Set componentStart to the character after the last slash (or start of pathname)
-    char *componentStart = lastSlash ? lastSlash + 1 : pathname;
-
-    // Compute length and validate
-    int componentLength = strlen(componentStart);
-    if (componentLength > DIRNAMELEN) {
-        TracePrintf(0, "ExtractLastComponent: Component '%s' exceeds maximum length\n", componentStart);
-        return ERROR;
-    }
-
-    // Safe copy
-    strncpy(component, componentStart, DIRNAMELEN - 1);
-    component[DIRNAMELEN - 1] = '\0';  // Ensure null-termination
-
-    return 0;
-}
-
-
-/**
- * Extracts the parent directory path from a path string
- * @param pathname Source path to parse
- * @param parentPath Buffer to store the parent path (must be pre-allocated)
- */
-static void ExtractParentPath(char *pathname, char *parentPath) {
-    if (pathname == NULL || parentPath == NULL) {
-        return;  // Safety check
-    }
-
-    int length = strlen(pathname);
-    if (length == 0) {
-        parentPath[0] = '\0';  // Empty pathname
-        return;
-    }
-
-    // Start from the end of pathname and move backwards to find the last slash
-    char *end = pathname + length - 1;
-    while (end >= pathname && *end != '/') {
-        --end;
-    }
-
-    if (end < pathname) {
-        // No slash found - relative path has no explicit parent
-        parentPath[0] = '\0';
-    } else if (end == pathname) {
-        // Single slash at the start (e.g., "/file") - parent is root
-        strcpy(parentPath, "/");
-    } else {
-        // Copy up to the last slash (excluding it)
-        int parentLength = end - pathname;
-        memcpy(parentPath, pathname, parentLength);
-        parentPath[parentLength] = '\0';  // Null-terminate
-    }
-}
-
-
-/**
- * Constructs a full path from a target path and a parent path
- * Handles both absolute and relative symlink targets
- * @param targetPath The symlink target path
- * @param parentPath The parent directory path
- * @param fullPath Buffer to store the constructed path (must be pre-allocated)
- */
-static void ConstructFullPath(char *targetPath, char *parentPath, char *fullPath) {
-    // Clear fullPath buffer
-    memset(fullPath, 0, MAXPATHNAMELEN);
-
-    // Handle absolute target path first
-    if (targetPath[0] == '/') {
-        // Direct copy for absolute path
-        strncpy(fullPath, targetPath, MAXPATHNAMELEN - 1);
-        return;
-    }
-
-    // If parent path is provided, concatenate parent and target
-    if (parentPath[0] != '\0') {
-        size_t parentLen = strlen(parentPath); 
-        strncpy(fullPath, parentPath, MAXPATHNAMELEN - 1);
-
-        // Add a '/' if not already present at the end of parent
-        if (parentLen > 0 && fullPath[parentLen - 1] != '/' && parentLen < MAXPATHNAMELEN - 1) {
-            fullPath[parentLen] = '/';
-            parentLen++;
-        }
-
-        // Append the targetPath after parent
-        strncat(fullPath, targetPath, MAXPATHNAMELEN - parentLen - 1);
-    } else {
-        // No parent provided, just copy targetPath
-        strncpy(fullPath, targetPath, MAXPATHNAMELEN - 1);
-    }
-
-    // Ensure null termination (though memset already clears the buffer)
-    fullPath[MAXPATHNAMELEN - 1] = '\0';
-}
-
-
 /**
  * Locates the parent directory inode for a path and extracts the final component
  * Handles path normalization and symbolic link resolution
- * @param pathname Path to analyze
+ * @param pathname Path to analyze, trailing slashes are removed in place
  * @param currentDirectory Starting directory inode number
- * @param component Buffer to store the final path component (must be pre-allocated)
+ * @param component Buffer of at least DIRNAMELEN + 1 bytes to store the final path component
+ * @param symlinkDepth The number of symbolic links followed so far, should not exceed MAXSYMLINKS
  * @return Inode number of parent directory on success, ERROR on failure
  */
-int CreateFindParent(char *pathname, int currentDirectory, char *component) {
+static int FindParentForCreate(char *pathname, int currentDirectory, char *component, int symlinkDepth) {
     TracePrintf(0, "CreateFindParent: Analyzing path '%s' from directory %d\n", 
                 pathname, currentDirectory);
     
     // Step 1: Normalize the path by removing trailing slashes
     TrimTrailingSlashes(pathname);
     
-    // Step 2: Extract the final component (filename/dirname)
-    if (ExtractLastComponent(pathname, component) == ERROR) {
-        TracePrintf(0, "CreateFindParent: Failed to extract last component\n");
+    // Step 2: Copy out the final component (filename/dirname), which is what the caller keeps
+    char *componentStart = getFilename(pathname);
+    int componentLength = strlen(componentStart);
+    if (componentLength > DIRNAMELEN) {
+        TracePrintf(0, "CreateFindParent: Component '%s' exceeds maximum length\n", componentStart);
         return ERROR;
     }
+    memcpy(component, componentStart, componentLength + 1);
     
-    // Step 3: Extract the parent path
-    char parentPath[MAXPATHNAMELEN];
-    ExtractParentPath(pathname, parentPath);
-    
-    // Step 4: Resolve the parent directory inode
-    TracePrintf(0, "CreateFindParent: Resolving parent path '%s'\n", parentPath);
-    
-    // If parent path is empty, use current directory as parent
-    int parentInum;
-    if (parentPath[0] == '\0') {
-        parentInum = currentDirectory;
-    } else {
-        parentInum = resolvePath(parentPath, currentDirectory, 0, 1);
-    }
+    // Step 3: Resolve the parent directory inode, the pathname is cut at its last slash in place
+    int parentInum = GetParentInum(currentDirectory, pathname);
     
     // Check if parent resolution failed
     if (parentInum <= 0) {
@@ -472,55 +354,54 @@ int CreateFindParent(char *pathname, int currentDirectory, char *component) {
         return ERROR;
     }
     
-    // Step 5: Get the parent directory inode entry
+    // Step 4: Get the parent directory inode entry
     InodeCacheEntry *parentEntry = GetInodeFromCache(parentInum);
     if (!parentEntry) {
         TracePrintf(0, "CreateFindParent: Failed to retrieve parent inode %d\n", parentInum);
         return ERROR;
     }
     
-    // Step 6: Check if the component already exists in parent directory
-    int existingInum = GetInumByComponentName(parentEntry, component);
+    // Step 5: Check if the component already exists in parent directory
+    int existingInum = GetInumByComponent(parentEntry, component, componentLength);
     
-    // Step 7: Handle symbolic link resolution if needed
+    // Step 6: Handle symbolic link resolution if needed
     if (existingInum > 0) {
         InodeCacheEntry *existingEntry = GetInodeFromCache(existingInum);
         
         // If the component is a symlink, resolve it recursively
         if (existingEntry && existingEntry->inodeInfo->type == INODE_SYMLINK) {
-            // Read the symlink target
-            char targetPath[MAXPATHNAMELEN];
-            int targetLength = existingEntry->inodeInfo->size;
-            
-            // Ensure the target length is within bounds
-            if (targetLength >= MAXPATHNAMELEN) {
-                targetLength = MAXPATHNAMELEN - 1;
+            if (symlinkDepth >= MAXSYMLINKS) {
+                TracePrintf(0, "CreateFindParent: Too many symlinks\n");
+                return ERROR;
             }
-            
-            // Get the block containing the symlink target
-            BlockCacheEntry *targetBlock = GetBlockFromCache(existingEntry->inodeInfo->direct[0]);
-            if (!targetBlock) {
+            char targetPath[MAXPATHNAMELEN + 1];
+            if (ReadSymbolicLinkTarget(existingEntry->inodeInfo, targetPath) == ERROR) {
                 TracePrintf(0, "CreateFindParent: Failed to read symlink target\n");
                 return ERROR;
             }
             
-            // Copy the target path and ensure null termination
-            memcpy(targetPath, targetBlock->data, targetLength);
-            targetPath[targetLength] = '\0';
-            
-            // Construct the full path and resolve recursively
-            char fullPath[MAXPATHNAMELEN];
-            ConstructFullPath(targetPath, parentPath, fullPath);
-            
+            // A relative target is resolved from the directory holding the link
             TracePrintf(0, "CreateFindParent: Following symlink from '%s' to '%s'\n", 
-                        component, fullPath);
-            return CreateFindParent(fullPath, currentDirectory, component);
+                        component, targetPath);
+            return FindParentForCreate(targetPath, parentInum, component, symlinkDepth + 1);
         }
     }
     
     // Return the parent inode number
     return parentInum;
 }
+
+/**
+ * Locates the parent directory inode for a path and extracts the final component
+ * @param pathname Path to analyze, trailing slashes are removed in place
+ * @param currentDirectory Starting directory inode number
+ * @param component Buffer of at least DIRNAMELEN + 1 bytes to store the final path component
+ * @return Inode number of parent directory on success, ERROR on failure
+ */
+int CreateFindParent(char *pathname, int currentDirectory, char *component) {
+    return FindParentForCreate(pathname, currentDirectory, component, 0);
+}
+
 /**
  * Get the filename from the pathname (last component before the last slash)
  * @param pathname The pathname to parse
@@ -557,7 +438,132 @@ int GetBlockNumberFromIndirectBlock(int indirectBlockNum, int index) {
 }
 
 /**
- * Remove the directory entry for a file from the parent directory
+ * Get a block of a directory from the cache by its index within the directory
+ * @return The block cache entry, or NULL on failure
+ */
+static struct BlockCacheEntry *GetDirectoryBlockEntry(struct inode *dirInode, int logicalBlock) {
+    int blockNumber;
+    if (logicalBlock < NUM_DIRECT) {
+        blockNumber = dirInode->direct[logicalBlock];
+    }
+    else {
+        blockNumber = GetDataBlockNumberFromIndirectBlock(dirInode->indirect, logicalBlock - NUM_DIRECT);
+    }
+    if (blockNumber <= 0) {
+        return NULL;
+    }
+    return GetBlockFromCache(blockNumber);
+}
+
+/**
+ * Move the live entries of a linear directory to the front, keeping their order.
+ * Entries only ever move to a lower or equal slot, so the blocks are rewritten in place front to back
+ * @param dirInodeEntry The inode cache entry of a linear directory
+ * @return The new size of the directory in bytes, or ERROR on failure
+ */
+static int CompactLinearDirectory(struct InodeCacheEntry *dirInodeEntry) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    int totalDirEntries = dirInode->size / sizeof(struct dir_entry);
+    char packed[BLOCKSIZE];
+    struct dir_entry *packedEntries = (struct dir_entry *)packed;
+    int packedCount = 0;
+    memset(packed, 0, BLOCKSIZE);
+
+    for (int i = 0; i < totalDirEntries; i += DIRENTRY_PER_BLOCK) {
+        struct BlockCacheEntry *blockEntry = GetDirectoryBlockEntry(dirInode, i / DIRENTRY_PER_BLOCK);
+        if (blockEntry == NULL) {
+            return ERROR;
+        }
+        struct dir_entry *dirEntries = (struct dir_entry *)blockEntry->data;
+        for (int j = 0; j < DIRENTRY_PER_BLOCK && i + j < totalDirEntries; j++) {
+            if (dirEntries[j].inum == 0) {
+                continue;
+            }
+            packedEntries[packedCount % DIRENTRY_PER_BLOCK] = dirEntries[j];
+            packedCount++;
+            if (packedCount % DIRENTRY_PER_BLOCK == 0) {
+                // The full block goes to a slot range this loop has already read
+                struct BlockCacheEntry *targetEntry = GetDirectoryBlockEntry(dirInode, packedCount / DIRENTRY_PER_BLOCK - 1);
+                if (targetEntry == NULL) {
+                    return ERROR;
+                }
+                memcpy(targetEntry->data, packed, BLOCKSIZE);
+                MarkBlockEntryDirty(targetEntry);
+                memset(packed, 0, BLOCKSIZE);
+            }
+        }
+    }
+    if (packedCount % DIRENTRY_PER_BLOCK != 0) {
+        struct BlockCacheEntry *targetEntry = GetDirectoryBlockEntry(dirInode, packedCount / DIRENTRY_PER_BLOCK);
+        if (targetEntry == NULL) {
+            return ERROR;
+        }
+        memcpy(targetEntry->data, packed, BLOCKSIZE);
+        MarkBlockEntryDirty(targetEntry);
+    }
+    return packedCount * sizeof(struct dir_entry);
+}
+
+/**
+ * Compact a directory once at least DIR_COMPACT_FREE_PERCENT of its slots are free and packing would need fewer
+ * blocks: the live entries are repacked and the blocks left empty at the end are freed. Index slots look free too,
+ * so an indexed directory is measured by the leaves and index nodes it would be rebuilt into. Names keep their inode numbers, so the name cache
+ * stays valid. A client partway through listing the directory would see entries move under its offset, so
+ * compaction waits until the listing reaches the end, for at most DIR_COMPACT_MAX_DEFERRALS removals
+ * @param dirInodeEntry The inode cache entry of the directory, with its metadata loaded
+ */
+static void CompactSparseDirectory(struct InodeCacheEntry *dirInodeEntry) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    int totalDirEntries = dirInode->size / sizeof(struct dir_entry);
+    int freeEntries = totalDirEntries - (dirInodeEntry->dirEntryCount + 2);
+    if (dirInode->size <= BLOCKSIZE || freeEntries * 100 < DIR_COMPACT_FREE_PERCENT * totalDirEntries) {
+        return;
+    }
+    if (IsIndexedDirectory(dirInodeEntry) &&
+        EstimateCompactedIndexBlocks(dirInodeEntry->dirEntryCount) >= (dirInode->size + BLOCKSIZE - 1) / BLOCKSIZE) {
+        return;
+    }
+    if (dirInodeEntry->dirReadOffset > 0 && dirInodeEntry->dirCompactDeferrals < DIR_COMPACT_MAX_DEFERRALS) {
+        dirInodeEntry->dirCompactDeferrals += 1;
+        return;
+    }
+
+    int newSize;
+    if (IsIndexedDirectory(dirInodeEntry)) {
+        int newBlocks = CompactIndexedDirectory(dirInodeEntry);
+        newSize = (newBlocks == ERROR) ? ERROR : newBlocks * BLOCKSIZE;
+    }
+    else {
+        newSize = CompactLinearDirectory(dirInodeEntry);
+    }
+    if (newSize == ERROR) {
+        TracePrintf(0, "CompactSparseDirectory: Could not compact directory %d\n", dirInodeEntry->inodeNumber);
+        return;
+    }
+    TracePrintf(0, "CompactSparseDirectory: Directory %d shrinks from %d to %d bytes\n",
+        dirInodeEntry->inodeNumber, dirInode->size, newSize);
+    ShrinkFile(dirInodeEntry, newSize);
+    dirInodeEntry->dirFreeHint = dirInodeEntry->dirEntryCount + 2;
+    dirInodeEntry->dirReadOffset = 0;
+    dirInodeEntry->dirCompactDeferrals = 0;
+}
+
+/**
+ * Record how far a client has read a directory, so that compaction does not move entries under a listing.
+ * A read reaching the end of the directory finishes the listing
+ * @param dirInodeEntry The inode cache entry of the directory
+ * @param endOffset The offset right after the last byte read
+ */
+void NoteDirectoryRead(struct InodeCacheEntry *dirInodeEntry, int endOffset) {
+    if (LoadDirectoryMetadata(dirInodeEntry) == ERROR) {
+        return;
+    }
+    dirInodeEntry->dirReadOffset = (endOffset < dirInodeEntry->inodeInfo->size) ? endOffset : 0;
+    dirInodeEntry->dirCompactDeferrals = 0;
+}
+
+/**
+ * Remove the directory entry for a file from the parent directory, compacting the directory if it became sparse
  * @param fileInum The inode number of the file to remove
  * @param filename The name of the file to remove
  * @param parentInodeEntry The inode cache entry of the parent directory
@@ -570,8 +576,20 @@ int RemoveEntryFromDir(int fileInum, char *filename, struct InodeCacheEntry *par
         return ERROR;
     }
 
+    if (LoadDirectoryMetadata(parentInodeEntry) == ERROR) {
+        return ERROR;
+    }
+
     int totalDirEntries = parentInode->size / sizeof(struct dir_entry);
-    parentInodeEntry->isDirty = 1;
+    MarkInodeEntryDirty(parentInodeEntry);
+    // An entry of an overflowed index may sit outside its leaf, the linear scan below finds it
+    if (IsIndexedDirectory(parentInodeEntry) &&
+        RemoveIndexedDirEntry(parentInodeEntry, fileInum, filename, strlen(filename)) == 0) {
+        EnterNameCache(parentInodeEntry->inodeNumber, parentInode->reuse, filename, strlen(filename), 0);
+        parentInodeEntry->dirEntryCount -= 1;
+        CompactSparseDirectory(parentInodeEntry);
+        return 0;
+    }
     for (int i = 0; i < totalDirEntries; i++) {
         // Get the block number of this directory entry
         // see what block the dir_entry is in
@@ -603,17 +621,80 @@ int RemoveEntryFromDir(int fileInum, char *filename, struct InodeCacheEntry *par
         the corresponding directory entry is modified so that its inum field is 0.
         The directory entry is then said to be free.
         */
-        if (dirEntry->inum == fileInum) {
+        // A file with several hard links in the same directory has several entries with its inum
+        if (dirEntry->inum == fileInum && strncmp(dirEntry->name, filename, DIRNAMELEN) == 0) {
             TracePrintf(0, "RemoveEntryFromDir: Found entry %s with inum %d at index %d\n", filename, fileInum, i);
             dirEntry->inum = 0;
             memset(dirEntry->name, 0, DIRNAMELEN);
-            blockEntry->isDirty = 1;
+            MarkBlockEntryDirty(blockEntry);
+            EnterNameCache(parentInodeEntry->inodeNumber, parentInode->reuse, filename, strlen(filename), 0);
+            parentInodeEntry->dirEntryCount -= 1;
+            if (i < parentInodeEntry->dirFreeHint) {
+                parentInodeEntry->dirFreeHint = i;
+            }
+            CompactSparseDirectory(parentInodeEntry);
             return 0;
         }
     }
     return ERROR;
 }
 
+/**
+ * Make sure the in-memory metadata of a directory (live entry count and free slot hint) is known.
+ * The directory is scanned once after its inode enters the inode cache or is reused,
+ * after that AddDirEntry and RemoveEntryFromDir keep the metadata up to date
+ * @param dirInodeEntry The inode cache entry of the directory
+ * @return 0 on success, ERROR on failure
+ */
+int LoadDirectoryMetadata(struct InodeCacheEntry *dirInodeEntry) {
+    struct inode *dirInode = dirInodeEntry->inodeInfo;
+    if (dirInodeEntry->dirEntryCount >= 0 && dirInodeEntry->dirMetaReuse == dirInode->reuse) {
+        return 0;
+    }
+    if (dirInode->type != INODE_DIRECTORY) {
+        return ERROR;
+    }
+    TracePrintf(0, "LoadDirectoryMetadata: Scanning directory %d\n", dirInodeEntry->inodeNumber);
+
+    int totalDirEntries = dirInode->size / sizeof(struct dir_entry);
+    int entryCount = 0;
+    int firstFree = totalDirEntries;
+    for (int i = 0; i < totalDirEntries; i += DIRENTRY_PER_BLOCK) {
+        int index = i / DIRENTRY_PER_BLOCK;
+        int blockNumber;
+        if (index < NUM_DIRECT) {
+            blockNumber = dirInode->direct[index];
+        }
+        else {
+            blockNumber = GetDataBlockNumberFromIndirectBlock(dirInode->indirect, index - NUM_DIRECT);
+        }
+        if (blockNumber <= 0) {
+            return ERROR;
+        }
+        struct BlockCacheEntry *blockEntry = GetBlockFromCache(blockNumber);
+        if (blockEntry == NULL) {
+            return ERROR;
+        }
+        struct dir_entry *dirEntries = (struct dir_entry *)blockEntry->data;
+        for (int j = 0; j < DIRENTRY_PER_BLOCK && i + j < totalDirEntries; j++) {
+            if (dirEntries[j].inum == 0) {
+                if (i + j < firstFree) {
+                    firstFree = i + j;
+                }
+            }
+            else if (strncmp(dirEntries[j].name, ".", DIRNAMELEN) != 0 && strncmp(dirEntries[j].name, "..", DIRNAMELEN) != 0) {
+                entryCount++;
+            }
+        }
+    }
+    dirInodeEntry->dirMetaReuse = dirInode->reuse;
+    dirInodeEntry->dirEntryCount = entryCount;
+    dirInodeEntry->dirFreeHint = firstFree;
+    dirInodeEntry->dirReadOffset = 0;
+    dirInodeEntry->dirCompactDeferrals = 0;
+    return 0;
+}
+
 /**
  * Parse the given pathname to remove consecutive slashes and normalize it
  * The trailing slash is treated as if followed by '.'
@@ -6,15 +6,21 @@
 #include <comp421/filesystem.h>
 #include "../cache/cache.h"
 
+#define DIR_COMPACT_FREE_PERCENT 50             // Compact a directory once this share of its entries are free
+#define DIR_COMPACT_MAX_DEFERRALS 256           // Removals a listing in progress may hold back compaction for
+
 int resolvePath(char* pathname,int inum, int symlinkDepth, int resolveLastSymLink);
-int GetComponent(char* pathname, char** componentName, int index);
+int GetComponent(char* pathname, int index, int* componentLength);
 int GetInumByComponentName(struct InodeCacheEntry *parentInodeEntry, char *componentName);
+int GetInumByComponent(struct InodeCacheEntry *parentInodeEntry, char *componentName, int componentLen);
 int GetDataBlockNumberFromIndirectBlock(int indirectBlockNum, int index);
 int ResolveSymbolicLink(int inum, struct inode* inodeInfo, int symlinkDepth);
 int GetParentInum(int inum, char* pathname);
 int CreateFindParent(char* pathname, int currentDirectory, char* component);
 char* getFilename(char* pathname);
 int RemoveEntryFromDir(int fileInum, char* filename, struct InodeCacheEntry* parentInodeEntry);
+int LoadDirectoryMetadata(struct InodeCacheEntry* dirInodeEntry);
+void NoteDirectoryRead(struct InodeCacheEntry* dirInodeEntry, int endOffset);
 int GetBlockNumberFromIndirectBlock(int indirectBlockNum, int index);
 int resolveTrailingSlash(char* originalPath);
 int verifyCwdReuse(char* pathname, int currentWorkingDirectory, int cwdReuse);
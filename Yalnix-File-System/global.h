@@ -10,7 +10,11 @@ struct InodeCacheEntry;			// Forward declaration of InodeCacheEntry struct
 #define MESSAGE_SIZE 32
 #define MAX_DIRECT_FILE_SIZE BLOCKSIZE * NUM_DIRECT
 #define MAX_INDIRECT_FILE_SIZE BLOCKSIZE * (BLOCKSIZE / sizeof(int))
-#define MAX_FILE_SIZE (int)(MAX_DIRECT_FILE_SIZE + MAX_INDIRECT_FILE_SIZE)
+#define MAX_DOUBLE_INDIRECT_FILE_SIZE MAX_INDIRECT_FILE_SIZE * (BLOCKSIZE / sizeof(int))
+#define MAX_TRIPLE_INDIRECT_FILE_SIZE MAX_DOUBLE_INDIRECT_FILE_SIZE * (BLOCKSIZE / sizeof(int))
+// Directories only use the direct and single indirect blocks, regular files also the double and triple indirect ones
+#define MAX_DIRECTORY_SIZE (int)(MAX_DIRECT_FILE_SIZE + MAX_INDIRECT_FILE_SIZE)
+#define MAX_FILE_SIZE (int)(MAX_DIRECTORY_SIZE + MAX_DOUBLE_INDIRECT_FILE_SIZE + MAX_TRIPLE_INDIRECT_FILE_SIZE)
 
 #define YFS_OPEN 1
 #define YFS_CLOSE 2
@@ -31,6 +35,34 @@ struct InodeCacheEntry;			// Forward declaration of InodeCacheEntry struct
 
 extern struct fs_header *fsHeader;
 
+/**
+ * The server's view of the file system header (inode 0). The fields after num_inodes live in the
+ * header padding, which mkfs leaves zeroed, so an image is only trusted once magic is set
+ */
+#define FS_CHECKPOINT_MAGIC 0x59465343      // "YFSC"
+
+struct fs_mount_header {
+    int num_blocks;
+    int num_inodes;
+    int magic;                  // FS_CHECKPOINT_MAGIC once checkpoint blocks have been reserved
+    int clean;                  // 1 after a clean shutdown, cleared again as soon as the server mounts
+    int checkpointStart;        // First of the blocks reserved for the free map checkpoint
+    int checkpointBlocks;       // Number of reserved checkpoint blocks
+    int rootTableStart;         // First block of the inode root table, 0 until a file first needs it
+    int rootTableBlocks;        // Number of inode root table blocks
+};
+
+/**
+ * Roots of the double and triple indirect blocks of an inode. struct inode has no room for them, so they are
+ * kept in the inode root table, indexed by inode number, in blocks reserved the first time a regular file grows
+ * past its single indirect block. Images without the table simply have no such files
+ */
+struct inode_roots {
+    int doubleIndirect;
+    int tripleIndirect;
+};
+#define ROOTS_PER_BLOCK (int)(BLOCKSIZE / sizeof(struct inode_roots))
+
 // YfsMsg struct should be exactly 32 bytes for message sending
 typedef struct YfsMsg {
 	int type;       // e.g., YFS_OPEN, YFS_READ, 4 bytes
@@ -42,10 +74,15 @@ typedef struct YfsMsg {
 } YfsMsg;
 
 void TruncateFile(struct InodeCacheEntry* inodeEntry);
+void ShrinkFile(struct InodeCacheEntry* inodeEntry, int newSize);
 int AllocateBlock();
+int ClaimBlock(int blockNum);
 int AllocateInode();
 int AllocateBlockInInode(struct InodeCacheEntry* inodeEntry);
 int AddDirEntry(int inum, char* filename, struct InodeCacheEntry* parentInodeEntry);
+void CheckpointFreeMaps();
+int ReserveRootTable();
+void PrintFragmentationStats();
 
 void YfsOpen(YfsMsg* msg, int senderPid);
 void YfsCreate(YfsMsg* msg, int senderPid);
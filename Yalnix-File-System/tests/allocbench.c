@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Block allocation microbenchmark.
+ * Fills the disk with files, deletes every tenth file so the disk is about
+ * 90% full with the free blocks scattered across it, and then allocates
+ * every remaining block again. The server prints the number of bitmap words
+ * scanned by the allocator (PrintFreeMapStats) on Shutdown.
+ */
+
+#define MAX_FILES 128
+#define FILE_BLOCKS 64
+
+/**
+ * Write a file of up to FILE_BLOCKS blocks, stopping when the disk is full
+ * @return The number of blocks written, or ERROR if the file cannot be created
+ */
+int FillFile(char *path, char *buf) {
+    int fd = Create(path);
+    if (fd == ERROR) {
+        return ERROR;
+    }
+    int blocks = 0;
+    while (blocks < FILE_BLOCKS && Write(fd, buf, BLOCKSIZE) == BLOCKSIZE) {
+        blocks++;
+    }
+    Close(fd);
+    return blocks;
+}
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    char buf[BLOCKSIZE];
+    int files, blocks, written, i;
+
+    memset(buf, 'x', sizeof(buf));
+
+    // Fill the disk
+    blocks = 0;
+    for (files = 0; files < MAX_FILES; files++) {
+        sprintf(path, "/alloc%d", files);
+        written = FillFile(path, buf);
+        if (written <= 0) {
+            break;
+        }
+        blocks += written;
+    }
+    printf("Filled disk with %d blocks in %d files\n", blocks, files);
+
+    // Free every tenth file
+    for (i = 0; i < files; i += 10) {
+        sprintf(path, "/alloc%d", i);
+        if (Unlink(path) == ERROR) {
+            printf("Something went wrong unlinking %s\n", path);
+            return -1;
+        }
+    }
+
+    // Allocate everything that was freed again
+    blocks = 0;
+    for (i = 0; i < files; i += 10) {
+        sprintf(path, "/alloc%d", i);
+        written = FillFile(path, buf);
+        if (written <= 0) {
+            break;
+        }
+        blocks += written;
+    }
+    printf("Refilled %d blocks on a 90%% full disk\n", blocks);
+
+    Shutdown();
+    return 0;
+}
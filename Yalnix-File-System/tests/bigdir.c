@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Large directory benchmark.
+ * Puts up to NUM_NAMES names into one directory and then looks every one of
+ * them up again. The names are hard links to a few target files, so the test
+ * is limited by the directory and not by the number of inodes. It stops at
+ * the first name the server refuses (for example when the directory reaches
+ * the maximum file size), then removes every other name and adds it again.
+ */
+
+#define NUM_NAMES 50000
+#define NUM_TARGETS 8
+
+int main() {
+    char target[MAXPATHNAMELEN];
+    char path[MAXPATHNAMELEN];
+    struct Stat stat;
+    int names, i, fd;
+
+    if (MkDir("/spool") == ERROR) {
+        printf("Something went wrong making /spool\n");
+        return -1;
+    }
+    for (i = 0; i < NUM_TARGETS; i++) {
+        sprintf(target, "/target%d", i);
+        fd = Create(target);
+        if (fd == ERROR) {
+            printf("Something went wrong creating %s\n", target);
+            return -1;
+        }
+        Close(fd);
+    }
+
+    for (names = 0; names < NUM_NAMES; names++) {
+        sprintf(target, "/target%d", names % NUM_TARGETS);
+        sprintf(path, "/spool/name%d", names);
+        if (Link(target, path) == ERROR) {
+            break;
+        }
+    }
+    printf("Added %d names to /spool\n", names);
+
+    for (i = 0; i < names; i++) {
+        sprintf(path, "/spool/name%d", i);
+        if (Stat(path, &stat) == ERROR || stat.inum < 2) {
+            printf("Something went wrong looking up %s\n", path);
+            return -1;
+        }
+    }
+    printf("Looked up %d names\n", names);
+
+    for (i = 0; i < names; i += 2) {
+        sprintf(path, "/spool/name%d", i);
+        if (Unlink(path) == ERROR) {
+            printf("Something went wrong unlinking %s\n", path);
+            return -1;
+        }
+    }
+    for (i = 0; i < names; i += 2) {
+        sprintf(target, "/target%d", i % NUM_TARGETS);
+        sprintf(path, "/spool/name%d", i);
+        if (Link(target, path) == ERROR) {
+            printf("Something went wrong linking %s again\n", path);
+            return -1;
+        }
+    }
+    printf("Removed and added back %d names\n", (names + 1) / 2);
+
+    Shutdown();
+    return 0;
+}
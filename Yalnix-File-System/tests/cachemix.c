@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Mixed metadata + streaming workload for comparing block cache policies.
+ * Stats a set of small files spread over a few directories between full
+ * sequential passes over a file much larger than the block cache.
+ * The server prints the block cache hit ratio (PrintBlockCacheStats) on Shutdown.
+ */
+
+#define NUM_DIRS 4
+#define FILES_PER_DIR 8
+#define ROUNDS 6
+#define BIG_SIZE (100 * BLOCKSIZE)
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    char buf[BLOCKSIZE];
+    struct Stat sb;
+    int fd;
+    int i, j, round;
+
+    // Metadata: a few directories holding small files
+    for (i = 0; i < NUM_DIRS; i++) {
+        sprintf(path, "/mix%d", i);
+        if (MkDir(path) == ERROR) {
+            printf("Something went wrong making directory %s\n", path);
+            return ERROR;
+        }
+        for (j = 0; j < FILES_PER_DIR; j++) {
+            sprintf(path, "/mix%d/f%d", i, j);
+            fd = Create(path);
+            Write(fd, path, strlen(path));
+            Close(fd);
+        }
+    }
+
+    // Streaming: one file several times larger than the block cache
+    memset(buf, 'x', BLOCKSIZE);
+    fd = Create("/stream");
+    for (i = 0; i < BIG_SIZE / BLOCKSIZE; i++) {
+        Write(fd, buf, BLOCKSIZE);
+    }
+    Close(fd);
+
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < NUM_DIRS; i++) {
+            for (j = 0; j < FILES_PER_DIR; j++) {
+                sprintf(path, "/mix%d/f%d", i, j);
+                if (Stat(path, &sb) == ERROR) {
+                    printf("Something went wrong stating %s\n", path);
+                    return ERROR;
+                }
+            }
+        }
+
+        fd = Open("/stream");
+        while (Read(fd, buf, BLOCKSIZE) > 0)
+            ;
+        Close(fd);
+    }
+
+    printf("Done\n");
+    Shutdown();
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * File creation storm.
+ * Creates empty files spread over several directories until the server runs
+ * out of inodes, removes half of them and creates them again, so the second
+ * round allocates inodes that are scattered over the whole inode table.
+ * Run it on images with different inode counts to compare the per-create cost.
+ */
+
+#define NUM_DIRS 16
+#define MAX_FILES 100000
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    int fd, files, i;
+
+    for (i = 0; i < NUM_DIRS; i++) {
+        sprintf(path, "/storm%d", i);
+        if (MkDir(path) == ERROR) {
+            printf("Something went wrong making directory %s\n", path);
+            return -1;
+        }
+    }
+
+    // Create until the inodes run out
+    for (files = 0; files < MAX_FILES; files++) {
+        sprintf(path, "/storm%d/f%d", files % NUM_DIRS, files);
+        fd = Create(path);
+        if (fd == ERROR) {
+            break;
+        }
+        Close(fd);
+    }
+    printf("Created %d files\n", files);
+
+    // Remove every other file and create them again
+    for (i = 0; i < files; i += 2) {
+        sprintf(path, "/storm%d/f%d", i % NUM_DIRS, i);
+        if (Unlink(path) == ERROR) {
+            printf("Something went wrong unlinking %s\n", path);
+            return -1;
+        }
+    }
+    for (i = 0; i < files; i += 2) {
+        sprintf(path, "/storm%d/f%d", i % NUM_DIRS, i);
+        fd = Create(path);
+        if (fd == ERROR) {
+            printf("Something went wrong recreating %s\n", path);
+            return -1;
+        }
+        Close(fd);
+    }
+    printf("Recreated %d files\n", (files + 1) / 2);
+
+    Shutdown();
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Deep path lookup benchmark.
+ * Builds a chain of directories, each also holding a batch of files so that
+ * a linear directory scan has something to walk past, and then repeatedly
+ * Stats and Opens a file at the bottom, plus a name that does not exist.
+ * The server prints the name cache hits and misses (PrintNameCacheStats) on Shutdown.
+ */
+
+#define DEPTH 8
+#define FILES_PER_DIR 40
+#define ROUNDS 200
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    char file[MAXPATHNAMELEN];
+    struct Stat stat;
+    int fd, depth, i;
+
+    path[0] = '\0';
+    for (depth = 0; depth < DEPTH; depth++) {
+        sprintf(path + strlen(path), "/level%d", depth);
+        if (MkDir(path) == ERROR) {
+            printf("Something went wrong making directory %s\n", path);
+            return -1;
+        }
+        for (i = 0; i < FILES_PER_DIR; i++) {
+            sprintf(file, "%s/filler%d", path, i);
+            fd = Create(file);
+            if (fd == ERROR) {
+                printf("Something went wrong creating %s\n", file);
+                return -1;
+            }
+            Close(fd);
+        }
+    }
+
+    for (i = 0; i < ROUNDS; i++) {
+        sprintf(file, "%s/filler%d", path, FILES_PER_DIR - 1);
+        if (Stat(file, &stat) == ERROR) {
+            printf("Something went wrong on Stat %s\n", file);
+            return -1;
+        }
+        fd = Open(file);
+        if (fd == ERROR) {
+            printf("Something went wrong on Open %s\n", file);
+            return -1;
+        }
+        Close(fd);
+
+        // A missing name should be answered by a negative entry
+        sprintf(file, "%s/missing", path);
+        if (Stat(file, &stat) != ERROR) {
+            printf("Stat on %s should have failed\n", file);
+            return -1;
+        }
+    }
+
+    // Removing and recreating a name must not leave a stale entry behind
+    sprintf(file, "%s/filler0", path);
+    if (Unlink(file) == ERROR || Stat(file, &stat) != ERROR) {
+        printf("Something went wrong unlinking %s\n", file);
+        return -1;
+    }
+    fd = Create(file);
+    if (fd == ERROR || Stat(file, &stat) == ERROR) {
+        printf("Something went wrong recreating %s\n", file);
+        return -1;
+    }
+    Close(fd);
+    printf("Looked up %d paths of depth %d\n", ROUNDS * 3, DEPTH + 1);
+
+    Shutdown();
+    return 0;
+}
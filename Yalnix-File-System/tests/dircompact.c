@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Directory compaction test.
+ * Fills a directory, lists part of it, unlinks most of the names while the
+ * listing is in progress and checks that the rest of the listing still sees
+ * every remaining name exactly once. Once the listing is done the next unlink
+ * lets the server compact the directory, which must then be smaller and
+ * still find every remaining name.
+ */
+
+#define NUM_FILES 300
+#define KEEP_EVERY 10
+#define LISTED_FIRST 20
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    int seen[NUM_FILES];
+    struct dir_entry entry;
+    struct Stat stat;
+    int fd, dirFd, i, n, fullSize;
+
+    if (MkDir("/shrink") == ERROR) {
+        printf("Something went wrong making /shrink\n");
+        return -1;
+    }
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/shrink/f%d", i);
+        fd = Create(path);
+        if (fd == ERROR) {
+            printf("Something went wrong creating %s\n", path);
+            return -1;
+        }
+        Close(fd);
+    }
+    Stat("/shrink", &stat);
+    fullSize = stat.size;
+    printf("/shrink holds %d names in %d bytes\n", NUM_FILES, fullSize);
+
+    // Start listing, then remove all names but every KEEP_EVERY-th one
+    memset(seen, 0, sizeof(seen));
+    dirFd = Open("/shrink");
+    for (i = 0; i < LISTED_FIRST && Read(dirFd, &entry, sizeof(entry)) == sizeof(entry); i++) {
+        if (entry.inum != 0 && sscanf(entry.name, "f%d", &n) == 1) {
+            seen[n]++;
+        }
+    }
+    for (i = 0; i < NUM_FILES; i++) {
+        if (i % KEEP_EVERY == 0) {
+            continue;
+        }
+        sprintf(path, "/shrink/f%d", i);
+        if (Unlink(path) == ERROR) {
+            printf("Something went wrong unlinking %s\n", path);
+            return -1;
+        }
+    }
+    while (Read(dirFd, &entry, sizeof(entry)) == sizeof(entry)) {
+        if (entry.inum != 0 && sscanf(entry.name, "f%d", &n) == 1) {
+            seen[n]++;
+        }
+    }
+    Close(dirFd);
+    for (i = 0; i < NUM_FILES; i += KEEP_EVERY) {
+        if (seen[i] != 1) {
+            printf("Listing saw f%d %d times\n", i, seen[i]);
+            return -1;
+        }
+    }
+    printf("Listing saw every remaining name once\n");
+
+    // The listing is over, removing one more name compacts the directory
+    if (Unlink("/shrink/f0") == ERROR) {
+        printf("Something went wrong unlinking /shrink/f0\n");
+        return -1;
+    }
+    Stat("/shrink", &stat);
+    if (stat.size >= fullSize) {
+        printf("/shrink did not shrink, still %d bytes\n", stat.size);
+        return -1;
+    }
+    printf("/shrink shrank from %d to %d bytes\n", fullSize, stat.size);
+    for (i = KEEP_EVERY; i < NUM_FILES; i += KEEP_EVERY) {
+        sprintf(path, "/shrink/f%d", i);
+        if (Stat(path, &stat) == ERROR) {
+            printf("Something went wrong looking up %s after compaction\n", path);
+            return -1;
+        }
+    }
+
+    // Emptying the directory brings it back to a single block and it can be removed
+    for (i = KEEP_EVERY; i < NUM_FILES; i += KEEP_EVERY) {
+        sprintf(path, "/shrink/f%d", i);
+        Unlink(path);
+    }
+    Stat("/shrink", &stat);
+    printf("/shrink is %d bytes once empty\n", stat.size);
+    if (RmDir("/shrink") == ERROR) {
+        printf("Something went wrong removing /shrink\n");
+        return -1;
+    }
+    printf("Directory compaction checks passed\n");
+
+    Shutdown();
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Large file test.
+ * Writes a file front to back in 64 KB pieces until the disk is full or
+ * FILE_LIMIT is reached, far past the direct and single indirect blocks,
+ * then reads it back and checks every piece. Then writes a few bytes at an
+ * offset that needs the triple indirect tree, checks that the hole before
+ * them reads as zeros, and truncates the file by creating it again, which
+ * must give all of its blocks back. Needs a disk of a few thousand blocks
+ * to get past the double indirect tree.
+ */
+
+#define PIECE (64 * 1024)
+#define FILE_LIMIT (64 * 1024 * 1024)
+#define FAR_OFFSET (512 * 1024 * 1024)
+
+static char buf[PIECE];
+static char check[PIECE];
+
+void Fill(int piece) {
+    for (int i = 0; i < PIECE; i++) {
+        buf[i] = (char)(i * 31 + piece * 7 + i / BLOCKSIZE);
+    }
+}
+
+int main() {
+    int fd, pieces, written, again, i;
+    struct Stat stat;
+
+    fd = Create("/huge");
+    if (fd == ERROR) {
+        printf("Something went wrong creating /huge\n");
+        return -1;
+    }
+
+    // Write until a Write comes up short, the disk is full then
+    written = 0;
+    for (pieces = 0; written < FILE_LIMIT; pieces++) {
+        Fill(pieces);
+        int n = Write(fd, buf, PIECE);
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+        if (n < PIECE) {
+            break;
+        }
+    }
+    printf("Wrote %d bytes to /huge\n", written);
+    if (written <= (NUM_DIRECT + BLOCKSIZE / (int)sizeof(int)) * BLOCKSIZE) {
+        printf("/huge did not grow past the single indirect block\n");
+        return -1;
+    }
+
+    Seek(fd, 0, SEEK_SET);
+    for (i = 0; i * PIECE < written; i++) {
+        int len = (written - i * PIECE < PIECE) ? written - i * PIECE : PIECE;
+        Fill(i);
+        if (Read(fd, check, len) != len || memcmp(check, buf, len) != 0) {
+            printf("/huge read back wrong at piece %d\n", i);
+            return -1;
+        }
+    }
+    printf("/huge reads back right\n");
+    Close(fd);
+
+    // Truncating gives every block back, so a file far into the triple indirect tree fits
+    fd = Create("/huge");
+    if (fd == ERROR || Seek(fd, FAR_OFFSET, SEEK_SET) != FAR_OFFSET || Write(fd, "far", 3) != 3) {
+        printf("Something went wrong writing at offset %d\n", FAR_OFFSET);
+        return -1;
+    }
+    if (Stat("/huge", &stat) == ERROR || stat.size != FAR_OFFSET + 3) {
+        printf("/huge has the wrong size after writing at offset %d\n", FAR_OFFSET);
+        return -1;
+    }
+    memset(buf, 0, PIECE);
+    if (Seek(fd, FAR_OFFSET - PIECE, SEEK_SET) != FAR_OFFSET - PIECE || Read(fd, check, PIECE) != PIECE ||
+        memcmp(check, buf, PIECE) != 0 || Read(fd, check, 3) != 3 || memcmp(check, "far", 3) != 0) {
+        printf("/huge reads back wrong around offset %d\n", FAR_OFFSET);
+        return -1;
+    }
+    Sync();
+    Seek(fd, FAR_OFFSET, SEEK_SET);
+    if (Read(fd, check, 3) != 3 || memcmp(check, "far", 3) != 0) {
+        printf("/huge reads back wrong after a sync\n");
+        return -1;
+    }
+    printf("/huge reads back right at offset %d\n", FAR_OFFSET);
+    Close(fd);
+
+    // A second truncate leaves nothing behind, the whole disk can be written again
+    fd = Create("/huge");
+    again = 0;
+    while (again < written) {
+        int n = Write(fd, buf, PIECE);
+        if (n <= 0) {
+            break;
+        }
+        again += n;
+        if (n < PIECE) {
+            break;
+        }
+    }
+    if (again < written) {
+        printf("Only %d of %d bytes fit after truncating /huge\n", again, written);
+        return -1;
+    }
+    printf("Wrote %d bytes to /huge again\n", again);
+    Close(fd);
+
+    Shutdown();
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Inline data test.
+ * Creates many tiny config files and short symbolic links, whose contents
+ * fit in the inode, and a long link that does not. Reads them all back,
+ * follows the links many times during path resolution, then grows a tiny
+ * file past the inode, shrinks one by creating it again and writes past its
+ * end. PrintBlockMapStats on Shutdown reports how many files stayed inline,
+ * the harness the disk reads this takes.
+ */
+
+#define NUM_FILES 32
+#define ROUNDS 200
+#define LONG_TARGET "/a/very/long/target/path/that/does/not/fit/in/the/inode/at/all"
+
+static char buf[1024];
+static char expect[1024];
+
+/*
+ * Read the whole of a file and compare it with the expected contents
+ */
+int Check(char *path, int size) {
+    int fd = Open(path);
+    if (fd == ERROR || Read(fd, buf, sizeof(buf)) != size || memcmp(buf, expect, size) != 0) {
+        printf("%s read back wrong\n", path);
+        return -1;
+    }
+    Close(fd);
+    return 0;
+}
+
+int main() {
+    char path[MAXPATHNAMELEN], link[MAXPATHNAMELEN];
+    int fd, i, round;
+
+    MkDir("/etc");
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/etc/conf%d", i);
+        sprintf(expect, "option%d=%d\n", i, i * 7);
+        fd = Create(path);
+        if (fd == ERROR || Write(fd, expect, strlen(expect)) != (int)strlen(expect)) {
+            printf("Something went wrong writing %s\n", path);
+            return -1;
+        }
+        Close(fd);
+        sprintf(link, "/l%d", i);
+        if (SymLink(path, link) == ERROR) {
+            printf("Something went wrong linking %s\n", link);
+            return -1;
+        }
+    }
+    if (SymLink(LONG_TARGET, "/long") == ERROR || ReadLink("/long", buf, sizeof(buf)) != (int)strlen(LONG_TARGET) ||
+        memcmp(buf, LONG_TARGET, strlen(LONG_TARGET)) != 0) {
+        printf("The long link reads back wrong\n");
+        return -1;
+    }
+    Sync();
+
+    // Every read goes through a link to a tiny file
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < NUM_FILES; i++) {
+            sprintf(link, "/l%d", i);
+            sprintf(expect, "option%d=%d\n", i, i * 7);
+            if (Check(link, strlen(expect)) == -1) {
+                return -1;
+            }
+        }
+    }
+    sprintf(expect, "/etc/conf%d", 3);
+    if (ReadLink("/l3", buf, sizeof(buf)) != (int)strlen(expect) || memcmp(buf, expect, strlen(expect)) != 0) {
+        printf("/l3 reads back wrong\n");
+        return -1;
+    }
+    printf("Read %d tiny files through links %d times\n", NUM_FILES, ROUNDS);
+
+    // Appending past the inode moves the contents to a block
+    fd = Open("/etc/conf0");
+    sprintf(expect, "option0=0\n");
+    Seek(fd, 0, SEEK_END);
+    for (i = strlen(expect); i < 600; i++) {
+        expect[i] = 'a' + i % 26;
+    }
+    if (Write(fd, expect + 10, 590) != 590) {
+        printf("Something went wrong growing /etc/conf0\n");
+        return -1;
+    }
+    Close(fd);
+    if (Check("/etc/conf0", 600) == -1) {
+        return -1;
+    }
+
+    // Creating a file again empties it, a write past the end leaves zeros in between
+    fd = Create("/etc/conf1");
+    if (fd == ERROR || Seek(fd, 20, SEEK_SET) != 20 || Write(fd, "tail", 4) != 4) {
+        printf("Something went wrong rewriting /etc/conf1\n");
+        return -1;
+    }
+    Close(fd);
+    memset(expect, 0, 20);
+    memcpy(expect + 20, "tail", 4);
+    if (Check("/etc/conf1", 24) == -1) {
+        return -1;
+    }
+    Sync();
+    if (Check("/etc/conf1", 24) == -1) {
+        return -1;
+    }
+    printf("All files read back correctly\n");
+
+    Shutdown();
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Multi-writer benchmark.
+ * Grows several files at once, appending one piece to each in turn, the way
+ * concurrent writers would, and then reads every file back to check it.
+ * The server reports how fragmented the files ended up
+ * (PrintFragmentationStats, average extent length per file) on Shutdown.
+ */
+
+#define NUM_FILES 4
+#define FILE_SIZE (128 * BLOCKSIZE)
+#define PIECE BLOCKSIZE
+
+static char buf[FILE_SIZE];
+static char check[FILE_SIZE];
+
+void Fill(int file) {
+    for (int i = 0; i < FILE_SIZE; i++) {
+        buf[i] = (char)(i * 5 + file * 31 + i / BLOCKSIZE);
+    }
+}
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    int fds[NUM_FILES];
+    int i, done;
+
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/m%d", i);
+        fds[i] = Create(path);
+        if (fds[i] == ERROR) {
+            printf("Something went wrong creating %s\n", path);
+            return -1;
+        }
+    }
+
+    // Every round appends one piece to each file
+    for (done = 0; done < FILE_SIZE; done += PIECE) {
+        for (i = 0; i < NUM_FILES; i++) {
+            Fill(i);
+            if (Write(fds[i], buf + done, PIECE) != PIECE) {
+                printf("Something went wrong appending to /m%d\n", i);
+                return -1;
+            }
+        }
+    }
+    printf("Appended %d bytes to each of %d files\n", FILE_SIZE, NUM_FILES);
+
+    for (i = 0; i < NUM_FILES; i++) {
+        Close(fds[i]);
+        sprintf(path, "/m%d", i);
+        int fd = Open(path);
+        Fill(i);
+        if (Read(fd, check, FILE_SIZE) != FILE_SIZE || memcmp(check, buf, FILE_SIZE) != 0) {
+            printf("%s read back wrong\n", path);
+            return -1;
+        }
+        Close(fd);
+    }
+    printf("All files read back correctly\n");
+
+    Shutdown();
+    return 0;
+}
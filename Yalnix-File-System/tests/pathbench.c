@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Path resolution microbenchmark.
+ * Builds a deep chain of directories and a chain of symbolic links that ends
+ * in it, plus a link to a directory that is used in the middle of paths, and
+ * then Stats, Opens and Creates through them many times.
+ */
+
+#define DEPTH 24
+#define LINKS 6
+#define ROUNDS 500
+
+int main() {
+    char deep[MAXPATHNAMELEN];
+    char path[MAXPATHNAMELEN];
+    char target[MAXPATHNAMELEN];
+    struct Stat stat;
+    int fd, i;
+
+    // /d/d/d/.../d with a file at the bottom
+    deep[0] = '\0';
+    for (i = 0; i < DEPTH; i++) {
+        strcat(deep, "/d");
+        if (MkDir(deep) == ERROR) {
+            printf("Something went wrong making directory %s\n", deep);
+            return -1;
+        }
+    }
+    sprintf(path, "%s/file", deep);
+    fd = Create(path);
+    if (fd == ERROR) {
+        printf("Something went wrong creating %s\n", path);
+        return -1;
+    }
+    Close(fd);
+
+    // /l0 -> /l1 -> ... -> /l(LINKS-1) -> the file, and /mid -> half way down the chain of directories
+    if (MkDir("/links") == ERROR) {
+        printf("Something went wrong making /links\n");
+        return -1;
+    }
+    for (i = 0; i < LINKS; i++) {
+        if (i == LINKS - 1) {
+            sprintf(target, "%s/file", deep);
+        }
+        else {
+            sprintf(target, "/links/l%d", i + 1);
+        }
+        sprintf(path, "/links/l%d", i);
+        if (SymLink(target, path) == ERROR) {
+            printf("Something went wrong linking %s\n", path);
+            return -1;
+        }
+    }
+    strcpy(target, deep);
+    target[DEPTH] = '\0';
+    if (SymLink(target, "/links/mid") == ERROR) {
+        printf("Something went wrong linking /links/mid\n");
+        return -1;
+    }
+
+    for (i = 0; i < ROUNDS; i++) {
+        sprintf(path, "%s/file", deep);
+        if (Stat(path, &stat) == ERROR) {
+            printf("Something went wrong on Stat %s\n", path);
+            return -1;
+        }
+        fd = Open("/links/l0");
+        if (fd == ERROR) {
+            printf("Something went wrong opening through the symlink chain\n");
+            return -1;
+        }
+        Close(fd);
+        sprintf(path, "/links/mid%s/file", deep + DEPTH);
+        if (Stat(path, &stat) == ERROR) {
+            printf("Something went wrong on Stat %s\n", path);
+            return -1;
+        }
+        sprintf(path, "/links/mid%s/new%d", deep + DEPTH, i % 4);
+        fd = Create(path);
+        if (fd == ERROR) {
+            printf("Something went wrong creating %s\n", path);
+            return -1;
+        }
+        Close(fd);
+    }
+    printf("Resolved %d paths\n", ROUNDS * 4);
+
+    Shutdown();
+    return 0;
+}
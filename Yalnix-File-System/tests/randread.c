@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Random read benchmark.
+ * Writes a file of the largest size an inode can map and then reads short
+ * pieces of it at pseudo-random offsets, checking the contents of every read.
+ * Most reads land past the direct blocks, the server reports how often it
+ * decoded a block map (PrintBlockMapStats) and its block cache lookups on
+ * Shutdown.
+ */
+
+#define FILE_BLOCKS (NUM_DIRECT + BLOCKSIZE / (int)sizeof(int))
+#define FILE_SIZE (FILE_BLOCKS * BLOCKSIZE)
+#define READ_SIZE 100
+#define ROUNDS 20000
+
+static char data[FILE_SIZE];
+
+int main() {
+    char buf[READ_SIZE];
+    unsigned int seed = 12345;
+    int fd, i;
+
+    for (i = 0; i < FILE_SIZE; i++) {
+        data[i] = (char)(i * 11 + i / 512);
+    }
+    fd = Create("/random");
+    if (fd == ERROR) {
+        printf("Something went wrong creating /random\n");
+        return -1;
+    }
+    if (Write(fd, data, FILE_SIZE) != FILE_SIZE) {
+        printf("Something went wrong writing /random\n");
+        return -1;
+    }
+
+    for (i = 0; i < ROUNDS; i++) {
+        seed = seed * 1103515245 + 12345;
+        int offset = (seed >> 8) % (FILE_SIZE - READ_SIZE);
+        Seek(fd, offset, SEEK_SET);
+        if (Read(fd, buf, READ_SIZE) != READ_SIZE) {
+            printf("Something went wrong reading /random at %d\n", offset);
+            return -1;
+        }
+        if (memcmp(buf, data + offset, READ_SIZE) != 0) {
+            printf("/random read back wrong at %d\n", offset);
+            return -1;
+        }
+    }
+    printf("Read %d pieces of %d bytes at random offsets\n", ROUNDS, READ_SIZE);
+    Close(fd);
+
+    Shutdown();
+    return 0;
+}
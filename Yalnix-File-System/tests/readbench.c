@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Large read benchmark.
+ * Writes a 64 KB file and then reads it back whole, 64 KB per Read, many
+ * times, checking the contents of every read.
+ */
+
+#define READ_SIZE (64 * 1024)
+#define ROUNDS 2000
+
+static char data[READ_SIZE];
+static char buf[READ_SIZE];
+
+int main() {
+    int fd, i;
+
+    for (i = 0; i < READ_SIZE; i++) {
+        data[i] = (char)(i * 7 + i / 512);
+    }
+    fd = Create("/big");
+    if (fd == ERROR) {
+        printf("Something went wrong creating /big\n");
+        return -1;
+    }
+    if (Write(fd, data, READ_SIZE) != READ_SIZE) {
+        printf("Something went wrong writing /big\n");
+        return -1;
+    }
+
+    for (i = 0; i < ROUNDS; i++) {
+        Seek(fd, 0, SEEK_SET);
+        if (Read(fd, buf, READ_SIZE) != READ_SIZE) {
+            printf("Something went wrong reading /big in round %d\n", i);
+            return -1;
+        }
+        if (memcmp(buf, data, READ_SIZE) != 0) {
+            printf("/big read back wrong in round %d\n", i);
+            return -1;
+        }
+    }
+    printf("Read %d bytes in %d reads of %d bytes\n", ROUNDS * READ_SIZE, ROUNDS, READ_SIZE);
+    Close(fd);
+
+    Shutdown();
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * RmDir emptiness test.
+ * Fills a directory, then removes its entries one by one checking that
+ * RmDir keeps failing until only "." and ".." are left. Enough directories
+ * are touched in between that the inode of the directory drops out of the
+ * inode cache, so the server has to recount its entries.
+ */
+
+#define NUM_FILES 40
+#define NUM_OTHER 40
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    int fd, i;
+
+    if (MkDir("/full") == ERROR) {
+        printf("Something went wrong making /full\n");
+        return -1;
+    }
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/full/f%d", i);
+        fd = Create(path);
+        if (fd == ERROR) {
+            printf("Something went wrong creating %s\n", path);
+            return -1;
+        }
+        Close(fd);
+    }
+
+    for (i = 0; i < NUM_FILES; i++) {
+        if (RmDir("/full") != ERROR) {
+            printf("RmDir succeeded with %d entries left\n", NUM_FILES - i);
+            return -1;
+        }
+        sprintf(path, "/full/f%d", i);
+        if (Unlink(path) == ERROR) {
+            printf("Something went wrong unlinking %s\n", path);
+            return -1;
+        }
+        // Push /full out of the inode cache every few rounds
+        if (i % 8 == 0) {
+            sprintf(path, "/other%d", i);
+            MkDir(path);
+            RmDir(path);
+        }
+    }
+    for (i = 0; i < NUM_OTHER; i++) {
+        sprintf(path, "/other%d", i);
+        MkDir(path);
+    }
+
+    // A new entry in a hole left by the unlinks, and then the directory is empty again
+    fd = Create("/full/again");
+    if (fd == ERROR) {
+        printf("Something went wrong creating /full/again\n");
+        return -1;
+    }
+    Close(fd);
+    if (RmDir("/full") != ERROR) {
+        printf("RmDir succeeded with /full/again left\n");
+        return -1;
+    }
+    if (Unlink("/full/again") == ERROR || RmDir("/full") == ERROR) {
+        printf("Something went wrong removing the empty directory\n");
+        return -1;
+    }
+    printf("RmDir emptiness checks passed\n");
+
+    Shutdown();
+    return 0;
+}
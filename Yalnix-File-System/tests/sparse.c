@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Sparse file test.
+ * Writes single bytes far past the end of a file, in the direct and in the
+ * indirect blocks, and checks that everything in between reads as zeros.
+ * Then fills part of a hole, truncates the file by creating it again and
+ * makes it sparse once more. The server only allocates the blocks that were
+ * written, PrintFragmentationStats on Shutdown reports how many that is.
+ */
+
+#define PIECE 100
+#define MAX_FILE_SIZE ((NUM_DIRECT + BLOCKSIZE / (int)sizeof(int)) * BLOCKSIZE)
+
+static char buf[MAX_FILE_SIZE];
+static char expect[MAX_FILE_SIZE];
+
+/*
+ * Write len bytes of value c at offset, into the file and into the expected contents
+ */
+int WriteAt(int fd, int offset, char c, int len) {
+    char piece[PIECE];
+    memset(piece, c, len);
+    memset(expect + offset, c, len);
+    if (Seek(fd, offset, SEEK_SET) != offset || Write(fd, piece, len) != len) {
+        printf("Something went wrong writing %d bytes at %d\n", len, offset);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Read the whole file back and compare it with the expected contents
+ */
+int Check(int fd, int size, char *when) {
+    struct Stat stat;
+    if (Stat("/sparse", &stat) == ERROR || stat.size != size) {
+        printf("/sparse has the wrong size %s\n", when);
+        return -1;
+    }
+    Seek(fd, 0, SEEK_SET);
+    if (Read(fd, buf, size) != size || memcmp(buf, expect, size) != 0) {
+        printf("/sparse read back wrong %s\n", when);
+        return -1;
+    }
+    printf("/sparse reads back right %s\n", when);
+    return 0;
+}
+
+int main() {
+    int fd;
+
+    fd = Create("/sparse");
+    if (fd == ERROR) {
+        printf("Something went wrong creating /sparse\n");
+        return -1;
+    }
+    memset(expect, 0, sizeof(expect));
+
+    // One byte in the first block and one at the very end leave the whole file in between a hole
+    if (WriteAt(fd, 0, 'a', 1) == -1 || WriteAt(fd, MAX_FILE_SIZE - 1, 'z', 1) == -1) {
+        return -1;
+    }
+    if (Check(fd, MAX_FILE_SIZE, "with one hole") == -1) {
+        return -1;
+    }
+
+    // Writes into the hole, within the direct blocks, across a block boundary and in the indirect blocks
+    if (WriteAt(fd, 5 * BLOCKSIZE + 7, 'b', PIECE) == -1 || WriteAt(fd, 9 * BLOCKSIZE - PIECE / 2, 'c', PIECE) == -1 ||
+        WriteAt(fd, 40 * BLOCKSIZE, 'd', PIECE) == -1) {
+        return -1;
+    }
+    if (Check(fd, MAX_FILE_SIZE, "after filling part of the hole") == -1) {
+        return -1;
+    }
+    Sync();
+    if (Check(fd, MAX_FILE_SIZE, "after a sync") == -1) {
+        return -1;
+    }
+    Close(fd);
+
+    // Creating the file again truncates it, then a byte in the indirect blocks makes it sparse again
+    fd = Create("/sparse");
+    memset(expect, 0, sizeof(expect));
+    if (fd == ERROR || WriteAt(fd, 100 * BLOCKSIZE + 3, 'e', 1) == -1) {
+        return -1;
+    }
+    if (Check(fd, 100 * BLOCKSIZE + 4, "after truncating") == -1) {
+        return -1;
+    }
+    Close(fd);
+
+    Shutdown();
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Stat benchmark.
+ * Creates NUM_FILES small files in one directory, one after another so their
+ * inodes share inode blocks, then Stats all of them in order ROUNDS times,
+ * like ls -l does. There are far more files than the inode cache holds, so
+ * every round misses in it. PrintInodeCacheStats on Shutdown reports the hit
+ * ratio and how many batch loaded inodes were used, the harness the disk
+ * reads this takes.
+ */
+
+#define NUM_FILES 256
+#define ROUNDS 20
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    struct Stat stat;
+    int fd, i, round;
+
+    MkDir("/ls");
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/ls/file%d", i);
+        fd = Create(path);
+        if (fd == ERROR || Write(fd, path, strlen(path)) != (int)strlen(path)) {
+            printf("Something went wrong creating %s\n", path);
+            return -1;
+        }
+        Close(fd);
+    }
+    Sync();
+
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < NUM_FILES; i++) {
+            sprintf(path, "/ls/file%d", i);
+            if (Stat(path, &stat) == ERROR || stat.type != INODE_REGULAR || stat.size != (int)strlen(path)) {
+                printf("%s has the wrong status\n", path);
+                return -1;
+            }
+        }
+    }
+    printf("Stat %d files %d times\n", NUM_FILES, ROUNDS);
+
+    Shutdown();
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Sync-heavy workload for measuring write-back ordering.
+ * Each batch creates and writes a file in every directory, appends to the
+ * files of earlier batches, and then calls Sync(), so every sync flushes
+ * dirty directory, inode and data blocks scattered across the disk.
+ * The server prints the total disk seek distance (PrintBlockCacheStats) on Shutdown.
+ */
+
+#define NUM_DIRS 4
+#define BATCHES 8
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    char buf[BLOCKSIZE];
+    int fd;
+    int i, batch, prev;
+
+    for (i = 0; i < NUM_DIRS; i++) {
+        sprintf(path, "/sync%d", i);
+        if (MkDir(path) == ERROR) {
+            printf("Something went wrong making directory %s\n", path);
+            return -1;
+        }
+    }
+
+    for (batch = 0; batch < BATCHES; batch++) {
+        memset(buf, 'a' + batch, sizeof(buf));
+        for (i = 0; i < NUM_DIRS; i++) {
+            sprintf(path, "/sync%d/f%d", i, batch);
+            fd = Create(path);
+            if (fd == ERROR) {
+                printf("Something went wrong creating %s\n", path);
+                return -1;
+            }
+            if (Write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+                printf("Something went wrong writing %s\n", path);
+                return -1;
+            }
+            Close(fd);
+
+            // Append a block to a file from an earlier batch
+            for (prev = 0; prev < batch; prev += 3) {
+                sprintf(path, "/sync%d/f%d", i, prev);
+                fd = Open(path);
+                if (fd == ERROR) {
+                    printf("Something went wrong opening %s\n", path);
+                    return -1;
+                }
+                Seek(fd, 0, SEEK_END);
+                Write(fd, buf, sizeof(buf));
+                Close(fd);
+            }
+        }
+        Sync();
+        printf("Batch %d synced\n", batch);
+    }
+
+    Shutdown();
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Sync then crash test. Run it twice on the same disk.
+ * The first run creates NUM_FILES files in /crash, Syncs, then writes 2 KB
+ * to each of them and returns without Shutdown: stop Yalnix then, so the
+ * server never shuts down cleanly. Most of the data already reached the
+ * disk through cache evictions, allocated after the Sync.
+ * The second run finds /crash, creates NUM_NEW more files with other data,
+ * then checks that every byte of the first files is still their own data,
+ * or a zero where a block never reached the disk. A Sync must not leave
+ * free maps behind that a remount trusts, or the new files would be given
+ * the blocks of the old ones.
+ */
+
+#define NUM_FILES 60
+#define NUM_NEW 40
+#define FILE_SIZE 2048
+
+static char buf[FILE_SIZE];
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    struct Stat stat;
+    int fd, i, j, n, bad;
+
+    if (Stat("/crash", &stat) == ERROR) {
+        MkDir("/crash");
+        for (i = 0; i < NUM_FILES; i++) {
+            sprintf(path, "/crash/old%d", i);
+            fd = Create(path);
+            if (fd == ERROR) {
+                printf("Something went wrong creating %s\n", path);
+                return -1;
+            }
+            Close(fd);
+        }
+        Sync();
+        for (i = 0; i < NUM_FILES; i++) {
+            sprintf(path, "/crash/old%d", i);
+            memset(buf, 'a' + i % 26, FILE_SIZE);
+            fd = Open(path);
+            if (fd == ERROR || Write(fd, buf, FILE_SIZE) != FILE_SIZE) {
+                printf("Something went wrong writing %s\n", path);
+                return -1;
+            }
+            Close(fd);
+        }
+        printf("Wrote %d files after a Sync, stop Yalnix now and run this again\n", NUM_FILES);
+        return 0;
+    }
+
+    // After the crash, new files must get blocks no old file uses
+    memset(buf, '#', FILE_SIZE);
+    for (i = 0; i < NUM_NEW; i++) {
+        sprintf(path, "/crash/new%d", i);
+        fd = Create(path);
+        if (fd == ERROR || Write(fd, buf, FILE_SIZE) != FILE_SIZE) {
+            printf("Something went wrong writing %s\n", path);
+            return -1;
+        }
+        Close(fd);
+    }
+    Sync();
+
+    bad = 0;
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/crash/old%d", i);
+        fd = Open(path);
+        n = (fd == ERROR) ? 0 : Read(fd, buf, FILE_SIZE);
+        for (j = 0; j < n; j++) {
+            if (buf[j] != 'a' + i % 26 && buf[j] != 0) {
+                printf("%s was overwritten at byte %d\n", path, j);
+                bad++;
+                break;
+            }
+        }
+        if (fd != ERROR) {
+            Close(fd);
+        }
+    }
+    printf("%d of %d files overwritten after the crash\n", bad, NUM_FILES);
+
+    Shutdown();
+    return bad == 0 ? 0 : -1;
+}
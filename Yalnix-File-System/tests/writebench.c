@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+
+/*
+ * Sequential write benchmark.
+ * Writes several 64 KB files front to back, block by block and in small
+ * unaligned pieces, then overwrites all of them again in 4 KB writes after
+ * they have left the block cache, and reads everything back to check it.
+ * The harness and the server (PrintBlockCacheStats on Shutdown) report the
+ * disk reads this takes.
+ */
+
+#define NUM_FILES 8
+#define FILE_SIZE (64 * 1024)
+#define SMALL_WRITE 100
+#define BIG_WRITE 4096
+
+static char buf[FILE_SIZE];
+static char check[FILE_SIZE];
+
+void Fill(int file, int round) {
+    for (int i = 0; i < FILE_SIZE; i++) {
+        buf[i] = (char)(i * 13 + file * 7 + round);
+    }
+}
+
+int main() {
+    char path[MAXPATHNAMELEN];
+    int fd, i, done;
+
+    // Even files are written one block per Write, odd ones in small unaligned pieces
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/w%d", i);
+        fd = Create(path);
+        if (fd == ERROR) {
+            printf("Something went wrong creating %s\n", path);
+            return -1;
+        }
+        Fill(i, 0);
+        int piece = (i % 2 == 0) ? BLOCKSIZE : SMALL_WRITE;
+        for (done = 0; done < FILE_SIZE; done += piece) {
+            int len = (FILE_SIZE - done < piece) ? FILE_SIZE - done : piece;
+            if (Write(fd, buf + done, len) != len) {
+                printf("Something went wrong writing %s\n", path);
+                return -1;
+            }
+        }
+        Close(fd);
+    }
+
+    // Overwrite every file whole, by now most of its blocks are no longer cached
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/w%d", i);
+        fd = Open(path);
+        Fill(i, 1);
+        for (done = 0; done < FILE_SIZE; done += BIG_WRITE) {
+            if (Write(fd, buf + done, BIG_WRITE) != BIG_WRITE) {
+                printf("Something went wrong overwriting %s\n", path);
+                return -1;
+            }
+        }
+        Close(fd);
+    }
+    printf("Wrote %d bytes\n", 2 * NUM_FILES * FILE_SIZE);
+
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/w%d", i);
+        fd = Open(path);
+        Fill(i, 1);
+        if (Read(fd, check, FILE_SIZE) != FILE_SIZE || memcmp(check, buf, FILE_SIZE) != 0) {
+            printf("%s read back wrong\n", path);
+            return -1;
+        }
+        Close(fd);
+    }
+    printf("All files read back correctly\n");
+
+    Shutdown();
+    return 0;
+}
@@ -13,103 +13,374 @@
 #include "global.h"
 #include "cache/cache.h"
 #include "fs/path.h"
+#include "fs/freemap.h"
+#include "fs/blockmap.h"
+#include "fs/namecache.h"
+#include "fs/dirindex.h"
 
 struct fs_header *fsHeader;
 
-// Free blocks tracking
-int *freeBlocksList;
-int freeBlocksCount;
+// State of a raw walk over the data blocks of a file, at mount or for the fragmentation statistics
+struct BlockWalk {
+    int firstDataBlock;         // Block numbers below this or past the end of the disk are not followed
+    int markUsed;               // Mark the data and indirect blocks walked as used in the free block map
+    int lastBlock;              // Disk block of the previous logical block, 0 after a hole
+    int blocks;                 // Data blocks walked
+    int extents;                // Runs of consecutive disk blocks they form
+};
 
-// Free inodes tracking
-int *freeInodesList;
-int freeInodesCount;
+/**
+ * Counts the next logical block of a file in a raw walk, a hole or a block number out of range ends the extent
+ * @param walk The walk
+ * @param blockNumber The disk block of the logical block, 0 for a hole
+ */
+static void walkDataBlock(struct BlockWalk* walk, int blockNumber) {
+    if (blockNumber < walk->firstDataBlock || blockNumber >= fsHeader->num_blocks) {
+        walk->lastBlock = 0;
+        return;
+    }
+    if (walk->markUsed) {
+        MarkBlockUsed(blockNumber);
+    }
+    walk->blocks++;
+    if (walk->lastBlock == 0 || blockNumber != walk->lastBlock + 1) {
+        walk->extents++;
+    }
+    walk->lastBlock = blockNumber;
+}
 
 /**
- * Initializes the freeInodesList array and freeInodesCount
+ * Walks a double or triple indirect tree with raw sector reads, in logical block order
+ * @param walk The walk
+ * @param blockNumber The indirect block at the top of the (sub)tree
+ * @param depth 1 for a leaf, up to 3 for the root of the triple indirect tree
+ * @param scratch One BLOCKSIZE buffer per depth
  */
-void initializeFreeInodes() {
-    TracePrintf(0, "initializeFreeInodes: Initializing free inodes\n");
-    freeInodesCount = 0;
-    // num_inodes does not contain inode 0 (fsHeader) 
-    freeInodesList = (int*)malloc(sizeof(int) * (fsHeader->num_inodes + 1));
-    TracePrintf(0, "initializeFreeInodes: fsHeader->num_inodes is %d\n", fsHeader->num_inodes);
-    freeInodesList[0] = 0; // inode 0 is not free for fsHeader
-    for (int i = 1; i <= fsHeader->num_inodes; i++) {
-        InodeCacheEntry* currInode = GetInodeFromCache(i);
-        if (currInode->inodeInfo->type == INODE_FREE) {
-            freeInodesList[i] = 1;
-            freeInodesCount += 1;
-        } else {
-            freeInodesList[i] = 0;
+static void walkIndirectTree(struct BlockWalk* walk, int blockNumber, int depth, int** scratch) {
+    if (blockNumber < walk->firstDataBlock || blockNumber >= fsHeader->num_blocks || ReadSector(blockNumber, scratch[depth - 1]) != 0) {
+        walk->lastBlock = 0;
+        return;
+    }
+    if (walk->markUsed) {
+        MarkBlockUsed(blockNumber);
+    }
+    int* blockNums = scratch[depth - 1];
+    for (int k = 0; k < INDIRECT_BLOCK_NUMS; k++) {
+        if (depth > 1 && blockNums[k] != 0) {
+            walkIndirectTree(walk, blockNums[k], depth - 1, scratch);
+        }
+        else {
+            walkDataBlock(walk, blockNums[k]);
         }
     }
-    TracePrintf(0, "initializeFreeInodes: There are %d free inodes\n", freeInodesCount);
 }
 
 /**
- * Initializes the freeBlocksList array and freeBlocksCount
+ * Walks the data blocks of a file: the ones within its size in the direct and single indirect blocks,
+ * then its double and triple indirect trees, if the file system has a root table
+ * @param walk The walk
+ * @param inum The inode number of the file
+ * @param inodeInfo The inode of the file
+ * @param rootTable The inode root table read with loadRootTable, or NULL
+ * @param scratch One BLOCKSIZE buffer per tree depth, and the decoded block map in scratch[3]
  */
-void initializeFreeBlocks() {
-    TracePrintf(0, "initializeFreeBlocks: Initializing free blocks\n");
-    freeBlocksCount = fsHeader->num_blocks;
-    TracePrintf(0, "initializeFreeBlocks: fsHeader->num_blocks is %d\n", fsHeader->num_blocks);
-
-    // num_blocks includes the total number of blocks in the file system
-    freeBlocksList = malloc(sizeof(int) * fsHeader->num_blocks);
-    for (int i = 0; i < fsHeader->num_blocks; i++) {
-        freeBlocksList[i] = 1; // Assume all blocks are free initially
-    }
-
-    // Mark the boot block as used
-    freeBlocksList[0] = 0;
-    freeBlocksCount -= 1;
-    TracePrintf(0, "initializeFreeBlocks: Marking boot block as used, freeBlocksCount is %d\n", freeBlocksCount);
-
-    // Mark the blocks used by inodes as used
-    int inodeBlockCount = (fsHeader->num_inodes + 1) / INODES_PER_BLOCK;
-    for (int i = 1; i <= inodeBlockCount; i++) {
-        freeBlocksList[i] = 0;
-        freeBlocksCount -= 1;
-    }
-    TracePrintf(0, "initializeFreeBlocks: Marking %d inode blocks as used, freeBlocksCount is %d\n", inodeBlockCount, freeBlocksCount);
-
-    // Go through each inode and mark the data blocks it uses as used
-    for (int i = 1; i <= fsHeader->num_inodes; i++) {
-        InodeCacheEntry* currInode = GetInodeFromCache(i);
-        if (currInode->inodeInfo->type != INODE_FREE) {
-            int j = 0;
-
-            // Deal with direct blocks
-            while (j < NUM_DIRECT && j * BLOCKSIZE < currInode->inodeInfo->size) {
-                if (currInode->inodeInfo->direct[j] != 0) {
-                    // Only mark the block as used if it is within the size of the file
-                    TracePrintf(0, "initializeFreeBlocks: Marking direct block %d as used\n", currInode->inodeInfo->direct[j]);
-                    freeBlocksList[currInode->inodeInfo->direct[j]] = 0;
-                    freeBlocksCount -= 1;
-                }
-                j++;
+static void walkFileBlocks(struct BlockWalk* walk, int inum, struct inode* inodeInfo, struct inode_roots* rootTable, int** scratch) {
+    // Inline data lives in the inode itself
+    if (HasInlineData(inodeInfo)) {
+        return;
+    }
+    int lastBlock = (inodeInfo->size + BLOCKSIZE - 1) / BLOCKSIZE;
+    if (lastBlock > MAPPED_FILE_BLOCKS) {
+        lastBlock = MAPPED_FILE_BLOCKS;
+    }
+    int hasIndirect = inodeInfo->indirect >= walk->firstDataBlock && inodeInfo->indirect < fsHeader->num_blocks;
+    if (hasIndirect && walk->markUsed) {
+        MarkBlockUsed(inodeInfo->indirect);
+    }
+    if (lastBlock > NUM_DIRECT && (!hasIndirect || ReadSector(inodeInfo->indirect, scratch[0]) != 0)) {
+        lastBlock = NUM_DIRECT;
+    }
+    DecodeBlockMap(inodeInfo, scratch[0], scratch[3], lastBlock);
+    for (int j = 0; j < lastBlock; j++) {
+        walkDataBlock(walk, scratch[3][j]);
+    }
+    if (rootTable != NULL && inodeInfo->type == INODE_REGULAR) {
+        if (rootTable[inum].doubleIndirect != 0) {
+            walkIndirectTree(walk, rootTable[inum].doubleIndirect, 2, scratch);
+        }
+        if (rootTable[inum].tripleIndirect != 0) {
+            walkIndirectTree(walk, rootTable[inum].tripleIndirect, 3, scratch);
+        }
+    }
+}
+
+/**
+ * Reads the whole inode root table with raw sector reads
+ * @return The table, one entry per inode, to be freed by the caller, or NULL if there is none or it cannot be read
+ */
+static struct inode_roots* loadRootTable() {
+    struct fs_mount_header* mountHeader = (struct fs_mount_header*)fsHeader;
+    if (mountHeader->magic != FS_CHECKPOINT_MAGIC || mountHeader->rootTableBlocks <= 0) {
+        return NULL;
+    }
+    struct inode_roots* rootTable = malloc((size_t)mountHeader->rootTableBlocks * BLOCKSIZE);
+    if (rootTable == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < mountHeader->rootTableBlocks; i++) {
+        if (ReadSector(mountHeader->rootTableStart + i, (char*)rootTable + i * BLOCKSIZE) != 0) {
+            TracePrintf(0, "loadRootTable: Error reading root table block %d\n", mountHeader->rootTableStart + i);
+            free(rootTable);
+            return NULL;
+        }
+    }
+    return rootTable;
+}
+
+/**
+ * Builds the free inode stack and the free block bitmap in one sweep over the inode table.
+ * The inode blocks are read in order with raw sector reads into a scratch buffer, so mounting
+ * does not push every inode through the caches. Indirect blocks of files are read the same way
+ * and decoded with DecodeBlockMap, like the block maps of cached inodes, and so are the double and
+ * triple indirect trees listed in the inode root table
+ */
+void initializeFreeMaps() {
+    TracePrintf(0, "initializeFreeMaps: num_inodes is %d, num_blocks is %d\n", fsHeader->num_inodes, fsHeader->num_blocks);
+    // num_inodes does not contain inode 0 (fsHeader), which is never free
+    InitializeFreeInodeMap(fsHeader->num_inodes);
+    // num_blocks includes the total number of blocks in the file system, all free initially
+    InitializeFreeBlockMap(fsHeader->num_blocks);
+
+    // The boot block and the inode table are always used
+    int inodeBlockCount = (fsHeader->num_inodes + 1 + INODES_PER_BLOCK - 1) / INODES_PER_BLOCK;
+    int firstDataBlock = inodeBlockCount + 1;
+    for (int i = 0; i < firstDataBlock; i++) {
+        MarkBlockUsed(i);
+    }
+    TracePrintf(0, "initializeFreeMaps: Marking %d inode blocks as used, freeBlocksCount is %d\n", inodeBlockCount, freeBlocksCount);
+
+    // So are the blocks reserved for the free map checkpoint and the inode root table
+    struct fs_mount_header* mountHeader = (struct fs_mount_header*)fsHeader;
+    if (mountHeader->magic == FS_CHECKPOINT_MAGIC) {
+        for (int i = 0; i < mountHeader->checkpointBlocks; i++) {
+            MarkBlockUsed(mountHeader->checkpointStart + i);
+        }
+        for (int i = 0; i < mountHeader->rootTableBlocks; i++) {
+            MarkBlockUsed(mountHeader->rootTableStart + i);
+        }
+    }
+
+    struct inode* inodeBlock = malloc(BLOCKSIZE);
+    int* scratch[4] = { malloc(BLOCKSIZE), malloc(BLOCKSIZE), malloc(BLOCKSIZE), malloc(sizeof(int) * MAPPED_FILE_BLOCKS) };
+    struct inode_roots* rootTable = loadRootTable();
+    struct BlockWalk walk = { firstDataBlock, 1, 0, 0, 0 };
+    int* freeInums = malloc(sizeof(int) * (fsHeader->num_inodes + 1));
+    int freeInumCount = 0;
+
+    for (int blockNumber = 1; blockNumber <= inodeBlockCount; blockNumber++) {
+        if (ReadSector(blockNumber, inodeBlock) == ERROR) {
+            TracePrintf(0, "initializeFreeMaps: Error reading inode block %d\n", blockNumber);
+            continue;
+        }
+        for (int k = 0; k < INODES_PER_BLOCK; k++) {
+            int inum = (blockNumber - 1) * INODES_PER_BLOCK + k;
+            if (inum == 0 || inum > fsHeader->num_inodes) {
+                continue;
+            }
+            struct inode* inodeInfo = &inodeBlock[k];
+            if (inodeInfo->type == INODE_FREE) {
+                freeInums[freeInumCount++] = inum;
+                continue;
             }
 
-            // Deal with indirect blocks
-            if (currInode->inodeInfo->indirect != 0) {
-                TracePrintf(0, "initializeFreeBlocks: Marking indirect block %d as used\n", currInode->inodeInfo->indirect);
-                freeBlocksList[currInode->inodeInfo->indirect] = 0;
-                freeBlocksCount -= 1;
-
-                // Round the block size to the nearest block
-                int lastBlock = (currInode->inodeInfo->size + BLOCKSIZE - 1) / BLOCKSIZE;
-                while (j < lastBlock) {
-                    int indrectBlockNum = j - NUM_DIRECT;
-                    TracePrintf(0, "initializeFreeBlocks: Marking indirect block %d as used\n", indrectBlockNum);
-                    freeBlocksList[indrectBlockNum] = 0;
-                    freeBlocksCount -= 1;
-                    j++;
-                }
+            // Only the blocks within the size of the file are in use, holes decode as 0 and are skipped
+            walkFileBlocks(&walk, inum, inodeInfo, rootTable, scratch);
+        }
+    }
+
+    // Push in descending order so that the lowest free inode is handed out first
+    for (int i = freeInumCount - 1; i >= 0; i--) {
+        FreeInode(freeInums[i]);
+    }
+
+    free(freeInums);
+    free(rootTable);
+    for (int i = 0; i < 4; i++) {
+        free(scratch[i]);
+    }
+    free(inodeBlock);
+    TracePrintf(0, "initializeFreeMaps: There are %d free inodes and %d free blocks\n", freeInodesCount, freeBlocksCount);
+}
+
+/**
+ * Reports how fragmented the regular files are: the number of extents (runs of consecutive disk blocks)
+ * their data blocks form, and the average extent length. Like initializeFreeMaps it reads the inode table
+ * and indirect blocks with raw sector reads, so it must run after the cache has been synced
+ */
+void PrintFragmentationStats() {
+    struct inode* inodeBlock = malloc(BLOCKSIZE);
+    int* scratch[4] = { malloc(BLOCKSIZE), malloc(BLOCKSIZE), malloc(BLOCKSIZE), malloc(sizeof(int) * MAPPED_FILE_BLOCKS) };
+    struct inode_roots* rootTable = loadRootTable();
+    int inodeBlockCount = (fsHeader->num_inodes + 1 + INODES_PER_BLOCK - 1) / INODES_PER_BLOCK;
+    int files = 0;
+    int blocks = 0;
+    int extents = 0;
+    long fileExtentLengths = 0;     // Sum over files of blocks / extents, in hundredths of a block
+
+    for (int blockNumber = 1; blockNumber <= inodeBlockCount; blockNumber++) {
+        if (ReadSector(blockNumber, inodeBlock) == ERROR) {
+            continue;
+        }
+        for (int k = 0; k < INODES_PER_BLOCK; k++) {
+            int inum = (blockNumber - 1) * INODES_PER_BLOCK + k;
+            struct inode* inodeInfo = &inodeBlock[k];
+            if (inum == 0 || inum > fsHeader->num_inodes || inodeInfo->type != INODE_REGULAR || inodeInfo->size <= 0) {
+                continue;
             }
+            // Holes are not part of any extent
+            struct BlockWalk walk = { inodeBlockCount + 1, 0, 0, 0, 0 };
+            walkFileBlocks(&walk, inum, inodeInfo, rootTable, scratch);
+            if (walk.blocks == 0) {
+                continue;
+            }
+            files++;
+            blocks += walk.blocks;
+            extents += walk.extents;
+            fileExtentLengths += 100L * walk.blocks / walk.extents;
         }
     }
 
-    TracePrintf(0, "initializeFreeBlocks: There are %d free blocks\n", freeBlocksCount);
+    free(rootTable);
+    for (int i = 0; i < 4; i++) {
+        free(scratch[i]);
+    }
+    free(inodeBlock);
+    if (files == 0) {
+        TracePrintf(0, "PrintFragmentationStats: No regular files with data\n");
+        return;
+    }
+    TracePrintf(0, "PrintFragmentationStats: %d files, %d blocks in %d extents, average extent length per file %ld.%02ld blocks\n",
+        files, blocks, extents, fileExtentLengths / files / 100, fileExtentLengths / files % 100);
+}
+
+/**
+ * Copies the in-memory file system header into block 1 in the cache, to be written with it
+ */
+static void markFsHeaderDirty() {
+    struct BlockCacheEntry* blockEntry = GetBlockFromCache(1);
+    if (blockEntry == NULL) {
+        TracePrintf(0, "markFsHeaderDirty: Error reading block 1\n");
+        return;
+    }
+    memcpy(blockEntry->data, fsHeader, sizeof(struct fs_header));
+    MarkBlockEntryDirty(blockEntry);
+}
+
+/**
+ * Writes the in-memory file system header back to block 1 and flushes it to disk
+ */
+static void writeFsHeader() {
+    markFsHeaderDirty();
+    SyncCache();
+}
+
+/**
+ * Sets up the free maps at mount. After a clean shutdown the checkpoint is loaded directly,
+ * otherwise the inode table is scanned. The clean flag is then cleared on disk, so a crash
+ * from here on forces a full scan at the next mount
+ */
+void mountFreeMaps() {
+    struct fs_mount_header* mountHeader = (struct fs_mount_header*)fsHeader;
+    int loaded = 0;
+    if (mountHeader->magic == FS_CHECKPOINT_MAGIC && mountHeader->clean) {
+        InitializeFreeInodeMap(fsHeader->num_inodes);
+        InitializeFreeBlockMap(fsHeader->num_blocks);
+        if (FreeMapCheckpointBlocks() == mountHeader->checkpointBlocks && LoadFreeMapCheckpoint(mountHeader->checkpointStart) == 0) {
+            TracePrintf(0, "mountFreeMaps: Loaded checkpoint, %d free inodes and %d free blocks\n", freeInodesCount, freeBlocksCount);
+            loaded = 1;
+        }
+    }
+    if (!loaded) {
+        TracePrintf(0, "mountFreeMaps: No clean checkpoint, scanning the inode table\n");
+        initializeFreeMaps();
+    }
+    if (mountHeader->clean) {
+        mountHeader->clean = 0;
+        writeFsHeader();
+    }
+}
+
+/**
+ * Writes the free maps to the checkpoint blocks and marks the file system clean.
+ * Called on shutdown after everything else has been synced. The checkpoint blocks are reserved
+ * from free space the first time, and stay reserved from then on
+ */
+void CheckpointFreeMaps() {
+    struct fs_mount_header* mountHeader = (struct fs_mount_header*)fsHeader;
+    // Reserved blocks are only held in memory, on disk they are free
+    ReleaseAllBlockReservations();
+    int blocks = FreeMapCheckpointBlocks();
+    if (mountHeader->magic != FS_CHECKPOINT_MAGIC || mountHeader->checkpointBlocks != blocks) {
+        int start = FindFreeRun(blocks);
+        if (start == ERROR) {
+            TracePrintf(0, "CheckpointFreeMaps: No room for %d checkpoint blocks\n", blocks);
+            return;
+        }
+        for (int i = 0; i < blocks; i++) {
+            MarkBlockUsed(start + i);
+        }
+        mountHeader->magic = FS_CHECKPOINT_MAGIC;
+        mountHeader->checkpointStart = start;
+        mountHeader->checkpointBlocks = blocks;
+        TracePrintf(0, "CheckpointFreeMaps: Reserved blocks %d to %d for the checkpoint\n", start, start + blocks - 1);
+    }
+    if (SaveFreeMapCheckpoint(mountHeader->checkpointStart) == ERROR) {
+        TracePrintf(0, "CheckpointFreeMaps: Error writing checkpoint\n");
+        return;
+    }
+    mountHeader->clean = 1;
+    writeFsHeader();
+}
+
+/**
+ * Reserves the inode root table, the first time a regular file grows past its single indirect block.
+ * The table takes one run of free blocks, is zeroed and goes into the header, which the next sync writes.
+ * The header padding is only trusted once magic is set, so an image without a checkpoint gets magic
+ * and no checkpoint blocks, which CheckpointFreeMaps reserves later as usual
+ * @return 0 on success, ERROR if there is no run of free blocks long enough
+ */
+int ReserveRootTable() {
+    struct fs_mount_header* mountHeader = (struct fs_mount_header*)fsHeader;
+    if (mountHeader->magic == FS_CHECKPOINT_MAGIC && mountHeader->rootTableBlocks > 0) {
+        return 0;
+    }
+    int blocks = (fsHeader->num_inodes + 1 + ROOTS_PER_BLOCK - 1) / ROOTS_PER_BLOCK;
+    if (freeBlocksCount - freeBlocksPromised < blocks) {
+        ReleaseAllBlockReservations();
+    }
+    int start = (freeBlocksCount - freeBlocksPromised < blocks) ? ERROR : FindFreeRun(blocks);
+    if (start == ERROR) {
+        TracePrintf(0, "ReserveRootTable: No room for %d root table blocks\n", blocks);
+        return ERROR;
+    }
+    for (int i = 0; i < blocks; i++) {
+        if (ClaimBlock(start + i) == ERROR) {
+            for (int j = 0; j <= i; j++) {
+                FreeBlock(start + j);
+            }
+            return ERROR;
+        }
+    }
+    if (mountHeader->magic != FS_CHECKPOINT_MAGIC) {
+        mountHeader->magic = FS_CHECKPOINT_MAGIC;
+        mountHeader->checkpointStart = 0;
+        mountHeader->checkpointBlocks = 0;
+    }
+    mountHeader->rootTableStart = start;
+    mountHeader->rootTableBlocks = blocks;
+    markFsHeaderDirty();
+    TracePrintf(0, "ReserveRootTable: Reserved blocks %d to %d for the inode root table\n", start, start + blocks - 1);
+    return 0;
 }
 
 /**
@@ -119,39 +390,81 @@ void initializeFreeBlocks() {
  */
 void TruncateFile(struct InodeCacheEntry* inodeEntry) {
     TracePrintf(0, "TruncateFile: Truncating file with inode number %d\n", inodeEntry->inodeNumber);
+    ShrinkFile(inodeEntry, 0);
+}
+
+/**
+ * Shrinks the file to newSize and frees the data blocks past the new end,
+ * and the indirect blocks once none of their data blocks are left.
+ * Also marks the inode entry as dirty.
+ * @param inodeEntry The inode entry of the file to shrink
+ * @param newSize The new size, not larger than the current size
+ */
+void ShrinkFile(struct InodeCacheEntry* inodeEntry, int newSize) {
     struct inode* inodeInfo = inodeEntry->inodeInfo;
+    int keepBlocks = (newSize + BLOCKSIZE - 1) / BLOCKSIZE;
+    TracePrintf(0, "ShrinkFile: Shrinking inode %d to %d bytes (%d blocks)\n", inodeEntry->inodeNumber, newSize, keepBlocks);
+
+    // Inline data has no blocks to free
+    if (HasInlineData(inodeInfo)) {
+        TrimInlineData(inodeInfo, newSize);
+        if (newSize < inodeInfo->size) {
+            inodeInfo->size = newSize;
+        }
+        MarkInodeEntryDirty(inodeEntry);
+        return;
+    }
 
-    // Free the direct data block
-    for (int i = 0; i < NUM_DIRECT; i++) {
-        if (inodeInfo->direct[i] == 0) {
-            break;
+    // The block map gives the numbers of the blocks to free without walking the indirect block
+    int cursor = GetAllocationCursor(inodeEntry);
+    if (cursor == ERROR) {
+        // The indirect block cannot be read, only the direct blocks can be freed
+        cursor = NUM_DIRECT;
+        while (cursor > 0 && inodeInfo->direct[cursor - 1] == 0) {
+            cursor--;
+        }
+    }
+    // The double and triple indirect trees go first, then the blocks in reach of the block map
+    FreeTreeBlocks(inodeEntry, keepBlocks);
+    if (cursor > MAPPED_FILE_BLOCKS) {
+        cursor = MAPPED_FILE_BLOCKS;
+    }
+    int blocks[MAPPED_FILE_BLOCKS];
+    if (keepBlocks < cursor && MapBlockRange(inodeEntry, keepBlocks, cursor, blocks, MAP_RESOLVE) == 0) {
+        for (int i = keepBlocks; i < cursor; i++) {
+            // Holes have no block to free
+            if (blocks[i - keepBlocks] > 0) {
+                TracePrintf(0, "ShrinkFile: Freeing data block %d\n", blocks[i - keepBlocks]);
+                FreeBlock(blocks[i - keepBlocks]);
+            }
         }
-        TracePrintf(0, "TruncateFile: Freeing direct data block %d\n", inodeInfo->direct[i]);
-        freeBlocksList[inodeInfo->direct[i]] = 1;
-        freeBlocksCount += 1;
+    }
+    for (int i = keepBlocks; i < cursor && i < NUM_DIRECT; i++) {
         inodeInfo->direct[i] = 0;
     }
 
-    // Free the indirect block and its data blocks
+    // Clear the freed entries of the indirect block, and free the indirect block if it is left empty
     if (inodeInfo->indirect > 0) {
-        TracePrintf(0, "TruncateFile: Traversing through data blocks pointing by indirect block %d\n", inodeInfo->indirect);
-    	for (int i = 0; i < (int)(BLOCKSIZE / sizeof(int)); i++) {
-    		int blockNum = GetDataBlockNumberFromIndirectBlock(inodeInfo->indirect, i);
-            if (blockNum == 0) {
-                break;
+        int first = (keepBlocks > NUM_DIRECT) ? keepBlocks - NUM_DIRECT : 0;
+        if (cursor - NUM_DIRECT > first) {
+            struct BlockCacheEntry* blockEntry = GetBlockFromCache(inodeInfo->indirect);
+            if (blockEntry != NULL) {
+                memset((int*)blockEntry->data + first, 0, sizeof(int) * (cursor - NUM_DIRECT - first));
+                MarkBlockEntryDirty(blockEntry);
             }
-            TracePrintf(0, "TruncateFile: Freeing indirect data block %d\n", blockNum);
-            freeBlocksList[blockNum] = 1;
-            freeBlocksCount += 1;
-    	}
-        TracePrintf(0, "TruncateFile: Freeing indirect block %d\n", inodeInfo->indirect);
-        freeBlocksList[inodeInfo->indirect] = 1;
-        freeBlocksCount += 1;
-        inodeInfo->indirect = 0;
-    }
-
-    inodeInfo->size = 0;
-    inodeEntry->isDirty = 1;
+        }
+        if (first == 0) {
+            TracePrintf(0, "ShrinkFile: Freeing indirect block %d\n", inodeInfo->indirect);
+            FreeBlock(inodeInfo->indirect);
+            inodeInfo->indirect = 0;
+        }
+    }
+
+    if (newSize < inodeInfo->size) {
+        inodeInfo->size = newSize;
+    }
+    TrimBlockMap(inodeEntry, keepBlocks);
+    MarkInodeEntryDirty(inodeEntry);
 }
 
 /**
@@ -160,28 +473,40 @@ void TruncateFile(struct InodeCacheEntry* inodeEntry) {
  */
 int AllocateBlock() {
     TracePrintf(0, "AllocateBlock: Allocating a block\n");
-    if (freeBlocksCount <= 0) {
+    // Blocks promised to delayed allocations are not free for anyone else, reserved runs go first
+    if (freeBlocksCount - freeBlocksPromised <= 0) {
+        // Blocks held back for files being appended are the last ones left to hand out
+        ReleaseAllBlockReservations();
+    }
+    if (freeBlocksCount - freeBlocksPromised <= 0) {
         TracePrintf(0, "AllocateBlock: No free blocks available\n");
         return ERROR;
     }
-    for (int i = 1; i < fsHeader->num_blocks; i++) {
-        if (freeBlocksList[i] == 1) {
-            freeBlocksList[i] = 0;
-            freeBlocksCount -= 1;
+    int blockNum = FindFreeBlock();
+    if (blockNum == ERROR) {
+        return ERROR;
+    }
+    return ClaimBlock(blockNum);
+}
 
-            // Make sure the block is zeroed out
-            struct BlockCacheEntry* blockEntry = GetBlockFromCache(i);
-            if (blockEntry == NULL) {
-                TracePrintf(0, "AllocateBlock: Failed to get block from cache\n");
-                return ERROR;
-            }
-            void* block = blockEntry->data;
-            memset(block, 0, BLOCKSIZE);
-            blockEntry->isDirty = 1;
-            return i;
-        }
+/**
+ * Marks a block found free, or reserved for a file, as used and zeroes it out
+ * @param blockNum The block number
+ * @return The block number, or ERROR if the block cannot be brought into the cache
+ */
+int ClaimBlock(int blockNum) {
+    MarkBlockUsed(blockNum);
+
+    // Make sure the block is zeroed out, its old contents on disk are never read
+    struct BlockCacheEntry* blockEntry = GetBlockForOverwrite(blockNum);
+    if (blockEntry == NULL) {
+        TracePrintf(0, "ClaimBlock: Failed to get block %d from cache\n", blockNum);
+        return ERROR;
     }
-    return ERROR;
+    void* block = blockEntry->data;
+    memset(block, 0, BLOCKSIZE);
+    MarkBlockEntryDirty(blockEntry);
+    return blockNum;
 }
 
 /**
@@ -194,71 +519,25 @@ int AllocateInode() {
         TracePrintf(0, "AllocateInode: No free inodes available\n");
         return ERROR;
     }
-    for (int i = 1; i <= fsHeader->num_inodes; i++) {
-        if (freeInodesList[i] == 1) {
-            freeInodesList[i] = 0;
-            freeInodesCount -= 1;
-            return i;
-        }
-    }
-    return ERROR;
+    return TakeFreeInode();
 }
 
 /**
- * Allocates a new data block in the inode
+ * Allocates a new data block in the inode, after the blocks it already has
  * @param inodeEntry The inode entry to allocate the block in
- * @return 0 on success, ERROR if no free blocks are available
+ * @return 0 on success, ERROR if no free blocks are available or the directory is as large as it can be
  */
 int AllocateBlockInInode(struct InodeCacheEntry* inodeEntry) {
-    struct inode* inodeInfo = inodeEntry->inodeInfo;
-    // Check if there is space in the direct blocks
-	for (int i = 0; i < NUM_DIRECT; i++) {
-		if (inodeInfo->direct[i] == 0) {
-			int blockNum = AllocateBlock();
-			if (blockNum == ERROR) {
-				return ERROR;
-			}
-			inodeInfo->direct[i] = blockNum;
-			inodeEntry->isDirty = 1;
-			return 0;
-		}
-	}
-
-    // If all direct blocks are used, use / allocate an indirect block
-	if (inodeInfo->indirect == 0) {
-		int blockNum = AllocateBlock();
-		if (blockNum == ERROR) {
-			return ERROR;
-		}
-
-        struct BlockCacheEntry* blockEntry = GetBlockFromCache(blockNum);
-        if (blockEntry == NULL) {
-            return ERROR;
-        }
-		void* block = blockEntry->data;
-		memset(block, 0, BLOCKSIZE);
-		inodeInfo->indirect = blockNum;
-        inodeEntry->isDirty = 1;
-	}
-
-    struct BlockCacheEntry* blockEntry = GetBlockFromCache(inodeInfo->indirect);
-    if (blockEntry == NULL) {
+    int cursor = GetAllocationCursor(inodeEntry);
+    if (cursor == ERROR) {
+        return ERROR;
+    }
+    // Directories are walked through the direct and single indirect blocks only
+    if (cursor >= MAX_DIRECTORY_SIZE / BLOCKSIZE) {
+        TracePrintf(0, "AllocateBlockInInode: Inode %d cannot grow past %d bytes\n", inodeEntry->inodeNumber, MAX_DIRECTORY_SIZE);
         return ERROR;
     }
-	void* block = blockEntry->data;
-	for (int i = 0; i < (int)(BLOCKSIZE / sizeof(int)); i++) {
-		if (((int*)block)[i] == 0) {
-			int blockNum = AllocateBlock();
-			if (blockNum == ERROR) {
-				return ERROR;
-			}
-			((int*)block)[i] = blockNum;
-			blockEntry->isDirty = 1;
-			return 0;
-		}
-	}
-
-	return ERROR;
+    return MapBlockRange(inodeEntry, cursor, cursor + 1, NULL, MAP_ALLOCATE);
 }
 
 /**
@@ -277,13 +556,25 @@ int AddDirEntry(int inum, char* filename, struct InodeCacheEntry* parentInodeEnt
         return ERROR;
     }
 
-    // Get the first free directory entry in the parent inode
     struct inode* parentInode = parentInodeEntry->inodeInfo;
+    if (LoadDirectoryMetadata(parentInodeEntry) == ERROR) {
+        return ERROR;
+    }
+    if (IsIndexedDirectory(parentInodeEntry)) {
+        if (AddIndexedDirEntry(parentInodeEntry, inum, filename, filenameLen) == ERROR) {
+            return ERROR;
+        }
+        EnterNameCache(parentInodeEntry->inodeNumber, parentInode->reuse, filename, filenameLen, inum);
+        parentInodeEntry->dirEntryCount += 1;
+        return 0;
+    }
+
+    // Get the first free directory entry in the parent inode, every entry below the hint is in use
     int totalDirEntries = parentInode->size / sizeof(struct dir_entry);
 
     int i;
     // Traverse the directory entries
-    for (i = 0; i < totalDirEntries; i++) {
+    for (i = (parentInodeEntry->dirFreeHint < totalDirEntries) ? parentInodeEntry->dirFreeHint : totalDirEntries; i < totalDirEntries; i++) {
         // Get the block number of this directory entry
         int index = i / DIRENTRY_PER_BLOCK;
         if (index >= NUM_DIRECT && parentInode->indirect == 0) {
@@ -311,8 +602,11 @@ int AddDirEntry(int inum, char* filename, struct InodeCacheEntry* parentInodeEnt
             dirEntry->inum = inum;
             memset(dirEntry->name, 0, DIRNAMELEN);
             memcpy(dirEntry->name, filename, filenameLen);
-            block->isDirty = 1;
-            parentInodeEntry->isDirty = 1;
+            MarkBlockEntryDirty(block);
+            MarkInodeEntryDirty(parentInodeEntry);
+            EnterNameCache(parentInodeEntry->inodeNumber, parentInode->reuse, filename, filenameLen, inum);
+            parentInodeEntry->dirEntryCount += 1;
+            parentInodeEntry->dirFreeHint = i + 1;
             return 0;
         }
     }
@@ -320,6 +614,11 @@ int AddDirEntry(int inum, char* filename, struct InodeCacheEntry* parentInodeEnt
     // If no free directory entry is found, setup a new dirEntry out of the current size
 
     TracePrintf(0, "AddDirEntry: No free directory entry found\n");
+    // A directory outgrowing its first block switches to the indexed layout
+    if (DIRECTORY_INDEX && parentInode->size == BLOCKSIZE && ConvertToIndexedDirectory(parentInodeEntry) == 0) {
+        return AddDirEntry(inum, filename, parentInodeEntry);
+    }
+
     // Allocate a new data block in the parent inode if needed
     if (parentInode->size % BLOCKSIZE == 0) {
         if (AllocateBlockInInode(parentInodeEntry) < 0) {
@@ -351,8 +650,11 @@ int AddDirEntry(int inum, char* filename, struct InodeCacheEntry* parentInodeEnt
     dirEntry->inum = inum;
     memset(dirEntry->name, 0, DIRNAMELEN);
     memcpy(dirEntry->name, filename, filenameLen);
-    block->isDirty = 1;
-    parentInodeEntry->isDirty = 1;
+    MarkBlockEntryDirty(block);
+    MarkInodeEntryDirty(parentInodeEntry);
+    EnterNameCache(parentInodeEntry->inodeNumber, parentInode->reuse, filename, filenameLen, inum);
+    parentInodeEntry->dirEntryCount += 1;
+    parentInodeEntry->dirFreeHint = i + 1;
     return 0;
 }
 
@@ -374,8 +676,8 @@ int main(int argc, char **argv) {
     }
 
     InitializeCache();
-    initializeFreeInodes();
-    initializeFreeBlocks();
+    InitializeNameCache();
+    mountFreeMaps();
 
     TracePrintf(0, "main: YFS server initialized\n");
 
@@ -449,6 +751,9 @@ int main(int argc, char **argv) {
                 TracePrintf(0, "main: Unknown message type %d\n", msgType);
                 break;
         }
+
+        // Handlers pin the cache entries they hold across other cache lookups, drop any left over
+        ReleaseCachePins();
     }
 
     return 0;
@@ -8,6 +8,83 @@
 #include "global.h"
 #include "fs/path.h"
 #include "cache/cache.h"
+#include "fs/freemap.h"
+#include "fs/blockmap.h"
+#include "fs/namecache.h"
+
+// Sequential access state of recently read inodes, direct mapped by inode number
+typedef struct ReadAheadState {
+    int inodeNumber;
+    int reuse;
+    int nextOffset;         // The offset right after the last read, a read starting here is sequential
+    int prefetchedUpTo;     // File block index right after the last block read ahead
+    int window;             // Number of blocks to keep read ahead, 0 while access is not sequential
+} ReadAheadState;
+
+static ReadAheadState readAheadStates[INODE_CACHESIZE];
+
+// What YfsRead copies out for a hole in a file, which has no block to read
+static char zeroBlock[BLOCKSIZE];
+
+/**
+ * Update the sequential access state of an inode after a read
+ * @param inodeNumber The inode that was read
+ * @param reuse The reuse count of the inode
+ * @param offset The offset the read started at
+ * @param endOffset The offset right after the last byte read
+ * @return The read-ahead state of the inode
+ */
+static ReadAheadState* TrackSequentialRead(int inodeNumber, int reuse, int offset, int endOffset) {
+    ReadAheadState* state = &readAheadStates[inodeNumber % INODE_CACHESIZE];
+    if (state->inodeNumber == inodeNumber && state->reuse == reuse && state->nextOffset == offset) {
+        // Sequential, open the window or double it
+        state->window = (state->window == 0) ? READ_AHEAD_MIN_WINDOW : state->window * 2;
+        if (state->window > READ_AHEAD_MAX_WINDOW) {
+            state->window = READ_AHEAD_MAX_WINDOW;
+        }
+    }
+    else {
+        state->inodeNumber = inodeNumber;
+        state->reuse = reuse;
+        state->prefetchedUpTo = 0;
+        state->window = 0;
+    }
+    state->nextOffset = endOffset;
+    return state;
+}
+
+/**
+ * Read ahead the data blocks following a sequential read into the block cache
+ * @param inodeEntry The inode cache entry being read
+ * @param state The read-ahead state of the inode
+ * @param lastBlock The index of the last file block the read touched
+ */
+static void ReadAhead(struct InodeCacheEntry* inodeEntry, ReadAheadState* state, int lastBlock) {
+    int from = lastBlock + 1;
+    int to = lastBlock + state->window;
+    int fileBlocks = (inodeEntry->inodeInfo->size + BLOCKSIZE - 1) / BLOCKSIZE;
+    if (from < state->prefetchedUpTo) {
+        from = state->prefetchedUpTo;
+    }
+    if (to >= fileBlocks) {
+        to = fileBlocks - 1;
+    }
+    int blockNums[BLOCK_MAP_BATCH];
+    for (int batchStart = from; batchStart <= to; batchStart += BLOCK_MAP_BATCH) {
+        int batchEnd = (to + 1 < batchStart + BLOCK_MAP_BATCH) ? to + 1 : batchStart + BLOCK_MAP_BATCH;
+        if (MapBlockRange(inodeEntry, batchStart, batchEnd, blockNums, MAP_RESOLVE) == ERROR) {
+            return;
+        }
+        for (int i = batchStart; i < batchEnd; i++) {
+            if (blockNums[i - batchStart] > 0) {
+                PrefetchBlock(blockNums[i - batchStart]);
+            }
+        }
+    }
+    if (to + 1 > state->prefetchedUpTo) {
+        state->prefetchedUpTo = to + 1;
+    }
+}
 
 void YfsOpen(YfsMsg* msg, int senderPid) {
     TracePrintf(0, "YfsOpen: Received message from process %d\n", senderPid);
@@ -93,7 +170,7 @@ void YfsCreate(YfsMsg* msg, int senderPid) {
         pathname[len - 2] = '\0';
     }
 
-    char filename[DIRNAMELEN];
+    char filename[DIRNAMELEN + 1];
     int parentInum = CreateFindParent(pathname, msg->data1, filename);
     TracePrintf(0, "YfsCreate: Parent inode number is %d\n", parentInum);
     TracePrintf(0, "YfsCreate: Target file name is %s\n", filename);
@@ -127,6 +204,7 @@ void YfsCreate(YfsMsg* msg, int senderPid) {
         Reply((void*)msg, senderPid);
         return;
     }
+    PinInode(parentInodeEntry);
 
     TracePrintf(0, "YfsCreate: Parent inode type is %d\n", parentInodeEntry->inodeInfo->type);
     if (parentInodeEntry->inodeInfo->type != INODE_DIRECTORY) {
@@ -198,7 +276,8 @@ void YfsCreate(YfsMsg* msg, int senderPid) {
     for (int i = 0; i < NUM_DIRECT; i++) {
         inodeInfo->direct[i] = 0;
     }
-    inodeEntry->isDirty = 1;
+    ClearTreeRoots(fileInum);
+    MarkInodeEntryDirty(inodeEntry);
     
     msg->data1 = fileInum;
     msg->data2 = inodeInfo->reuse;
@@ -251,72 +330,82 @@ void YfsRead(YfsMsg* msg, int senderPid) {
         size = inodeInfo->size - offset;
     }
 
+    // Inline data is copied straight out of the inode, without a block
+    if (HasInlineData(inodeInfo)) {
+        if (CopyTo(senderPid, buf, GetInlineData(inodeInfo) + offset, size) == ERROR) {
+            TracePrintf(0, "YfsRead: Error copying data to process %d\n", senderPid);
+            msg->type = ERROR;
+            Reply((void*)msg, senderPid);
+            return;
+        }
+        msg->data1 = size;
+        Reply((void*)msg, senderPid);
+        return;
+    }
+
     int bytesRead = 0;
-    char* tempBuf = (char*)malloc(size);
 
     // The direct or indirect blocks to start reading from
     int startBlock = offset / BLOCKSIZE;
     int endBlock = (offset + size - 1) / BLOCKSIZE;
     TracePrintf(0, "YfsRead: startBlock %d, endBlock %d\n", startBlock, endBlock);
 
+    int blockNums[BLOCK_MAP_BATCH];
+    int batchStart = startBlock;
+    int batchEnd = startBlock;
     for (int i = startBlock; i <= endBlock; i++) {
-        // Get the data block number
-        int blockNum;
-        if (i < NUM_DIRECT) {
-            blockNum = inodeInfo->direct[i];
-        } 
-        else {
-            blockNum = GetDataBlockNumberFromIndirectBlock(inodeInfo->indirect, i - NUM_DIRECT);
+        // Map the next batch of data block numbers once the previous one is used up
+        if (i == batchEnd) {
+            batchStart = i;
+            batchEnd = (endBlock + 1 < i + BLOCK_MAP_BATCH) ? endBlock + 1 : i + BLOCK_MAP_BATCH;
+            if (MapBlockRange(inodeEntry, batchStart, batchEnd, blockNums, MAP_RESOLVE) == ERROR) {
+                msg->type = ERROR;
+                Reply((void*)msg, senderPid);
+                return;
+            }
         }
+        int blockNum = blockNums[i - batchStart];
 
-        // Get the data block from the cache
-        struct BlockCacheEntry* blockEntry = GetBlockFromCache(blockNum);
-        if (blockEntry == NULL) {
+        // Get the data block from the cache, a hole reads as zeros without touching the disk
+        char* data = zeroBlock;
+        if (blockNum != 0) {
+            struct BlockCacheEntry* blockEntry = GetBlockFromCache(blockNum);
+            if (blockEntry == NULL) {
+                msg->type = ERROR;
+                Reply((void*)msg, senderPid);
+                return;
+            }
+            data = (char*)blockEntry->data;
+        }
+
+        // Copy the part of the block that falls into the read straight from the cache to the process
+        int offsetInBlock = (i == startBlock) ? offset % BLOCKSIZE : 0;
+        int bytesToRead = BLOCKSIZE - offsetInBlock;
+        if (bytesToRead > size - bytesRead) {
+            bytesToRead = size - bytesRead;
+        }
+        if (CopyTo(senderPid, (char*)buf + bytesRead, data + offsetInBlock, bytesToRead) == ERROR) {
+            TracePrintf(0, "YfsRead: Error copying data to process %d\n", senderPid);
             msg->type = ERROR;
             Reply((void*)msg, senderPid);
             return;
         }
-        char* blockData = (char*)blockEntry->data;
-
-        if (i == startBlock && i == endBlock) {
-            // Read from the same block, and this is the only block to read from
-            int offsetInBlock = offset % BLOCKSIZE;
-            memcpy(tempBuf, blockData + offsetInBlock, size);
-            bytesRead += size;
-        } 
-        else if (i == startBlock) {
-            // Read from the start block
-            int offsetInBlock = offset % BLOCKSIZE;
-            int bytesToRead = BLOCKSIZE - offsetInBlock;
-            memcpy(tempBuf, blockData + offsetInBlock, bytesToRead);
-            bytesRead += bytesToRead;
-        } 
-        else if (i == endBlock) {
-            // Read from the end block
-            int bytesToRead = size - bytesRead;
-            memcpy(tempBuf + bytesRead, blockData, bytesToRead);
-            bytesRead += bytesToRead;
-        } 
-        else {
-            // Read from a full block
-            memcpy(tempBuf + bytesRead, blockData, BLOCKSIZE);
-            bytesRead += BLOCKSIZE;
-        }
+        bytesRead += bytesToRead;
     }
 
     TracePrintf(0, "YfsRead: Read %d bytes from file (inode %d)\n", bytesRead, inodeNumber);
-    // Copy the data to the buffer
-    if (CopyTo(senderPid, buf, tempBuf, bytesRead) == ERROR) {
-        TracePrintf(0, "YfsRead: Error copying data to process %d\n", senderPid);
-        msg->type = ERROR;
-        Reply((void*)msg, senderPid);
-        free(tempBuf);
-        return;
-    }
-
-    free(tempBuf);
     msg->data1 = bytesRead;
     Reply((void*)msg, senderPid);
+
+    if (inodeInfo->type == INODE_DIRECTORY) {
+        NoteDirectoryRead(inodeEntry, offset + bytesRead);
+    }
+
+    // Read ahead after replying, so the client is already running while the next blocks come in
+    ReadAheadState* state = TrackSequentialRead(inodeNumber, reuse, offset, offset + bytesRead);
+    if (state->window > 0) {
+        ReadAhead(inodeEntry, state, endBlock);
+    }
     return;
 }
 
@@ -361,25 +450,46 @@ void YfsWrite(YfsMsg* msg, int senderPid) {
     }
 
     // If attempting to write more than MAX_FILE_SIZE, truncate the size
-    if (offset + size > MAX_FILE_SIZE) {
+    if (size > MAX_FILE_SIZE - offset) {
         size = MAX_FILE_SIZE - offset;
     }
 
-    // Allocate new data blocks up to the (offset + size - 1)
-    int fileEndBlock = (inodeInfo->size == 0) ? -1 : (inodeInfo->size - 1) / BLOCKSIZE;
-    int writeEndBlock = (offset + size - 1) / BLOCKSIZE;
-    int blocksToAllocate = writeEndBlock - fileEndBlock;
-    for (int i = 0; i < blocksToAllocate; i++) {
-        if (AllocateBlockInInode(inodeEntry) == ERROR) {
-            TracePrintf(0, "YfsWrite: Not enough block to allocate new data block\n");
+    // A small file is kept inline in the inode until a write makes it too large
+    int inlineWrite = PrepareInlineWrite(inodeEntry, offset + size);
+    if (inlineWrite == ERROR) {
+        TracePrintf(0, "YfsWrite: Not enough block to move the inline data of inode %d\n", inodeNumber);
+        msg->type = ERROR;
+        Reply((void*)msg, senderPid);
+        return;
+    }
+    if (inlineWrite == 1) {
+        if (CopyFrom(senderPid, GetInlineData(inodeInfo) + offset, buf, size) == ERROR) {
+            TracePrintf(0, "YfsWrite: Error copying data from process %d\n", senderPid);
             msg->type = ERROR;
             Reply((void*)msg, senderPid);
             return;
         }
+        if (offset + size > inodeInfo->size) {
+            inodeInfo->size = offset + size;
+        }
+        MarkInodeEntryDirty(inodeEntry);
+        msg->data1 = size;
+        Reply((void*)msg, senderPid);
+        return;
     }
 
-    // For holes between the current file size and the offset - 1, fill with zeros
-    // Since when we allocate a new block, we zero out its content, here we don't need to refill the holes
+    // Give the blocks the write touches a block: holes inside the file get one now, blocks past its end become
+    // delayed blocks that get disk blocks together later on. The free blocks they need are promised now,
+    // so running out of space still fails this write
+    if (DelayBlockRange(inodeEntry, offset / BLOCKSIZE, (offset + size - 1) / BLOCKSIZE + 1) == ERROR) {
+        TracePrintf(0, "YfsWrite: Not enough block to allocate new data block\n");
+        msg->type = ERROR;
+        Reply((void*)msg, senderPid);
+        return;
+    }
+
+    // Blocks between the current file size and the offset that the write does not touch stay holes,
+    // they read as zeros. New blocks start out zero filled, so the rest of a touched block reads as zeros too
 
     // Write the data to the file
     int bytesWrite = 0;
@@ -388,58 +498,63 @@ void YfsWrite(YfsMsg* msg, int senderPid) {
     int startBlock = offset / BLOCKSIZE;
     int endBlock = (offset + size - 1) / BLOCKSIZE;
     TracePrintf(0, "YfsWrite: startBlock %d, endBlock %d\n", startBlock, endBlock);
+
+    int blockNums[BLOCK_MAP_BATCH];
+    int batchStart = startBlock;
+    int batchEnd = startBlock;
     for (int i = startBlock; i <= endBlock; i++) {
-        // Get the data block number
-        int blockNum;
-        if (i < NUM_DIRECT) {
-            blockNum = inodeInfo->direct[i];
-        } 
-        else {
-            blockNum = GetDataBlockNumberFromIndirectBlock(inodeInfo->indirect, i - NUM_DIRECT);
+        // Map the next batch of data block numbers once the previous one is used up
+        if (i == batchEnd) {
+            batchStart = i;
+            batchEnd = (endBlock + 1 < i + BLOCK_MAP_BATCH) ? endBlock + 1 : i + BLOCK_MAP_BATCH;
+            if (MapBlockRange(inodeEntry, batchStart, batchEnd, blockNums, MAP_RESOLVE) == ERROR) {
+                msg->type = ERROR;
+                Reply((void*)msg, senderPid);
+                return;
+            }
         }
+        int blockNum = blockNums[i - batchStart];
 
-        // Get the data block from the cache
-        struct BlockCacheEntry* blockEntry = GetBlockFromCache(blockNum);
+        // The part of the block that falls into the write
+        int offsetInBlock = (i == startBlock) ? offset % BLOCKSIZE : 0;
+        int bytesToWrite = BLOCKSIZE - offsetInBlock;
+        if (bytesToWrite > size - bytesWrite) {
+            bytesToWrite = size - bytesWrite;
+        }
+
+        // Get the data block from the cache, a block the write covers completely is not read from disk first
+        struct BlockCacheEntry* blockEntry = NULL;
+        if (blockNum == 0) {
+            TracePrintf(0, "YfsWrite: Block %d of inode %d is still a hole\n", i, inodeNumber);
+        }
+        else if (bytesToWrite == BLOCKSIZE) {
+            blockEntry = GetBlockForOverwrite(blockNum);
+        }
+        else {
+            blockEntry = GetBlockFromCache(blockNum);
+        }
         if (blockEntry == NULL) {
             msg->type = ERROR;
             Reply((void*)msg, senderPid);
             return;
         }
-        char* blockData = (char*)blockEntry->data;
-
-        if (i == startBlock && i == endBlock) {
-            // Read from the same block, and this is the only block to read from
-            int offsetInBlock = offset % BLOCKSIZE;
-            CopyFrom(senderPid, blockData + offsetInBlock, buf, size);
-            bytesWrite += size;
-            blockEntry->isDirty = 1;
-        } 
-        else if (i == startBlock) {
-            // Read from the start block
-            int offsetInBlock = offset % BLOCKSIZE;
-            int bytesToWrite = BLOCKSIZE - offsetInBlock;
-            CopyFrom(senderPid, blockData + offsetInBlock, buf + bytesWrite, bytesToWrite);
-            bytesWrite += bytesToWrite;
-            blockEntry->isDirty = 1;
-        } 
-        else if (i == endBlock) {
-            // Read from the end block
-            int bytesToWrite = size - bytesWrite;
-            CopyFrom(senderPid, blockData, buf + bytesWrite, bytesToWrite);
-            bytesWrite += bytesToWrite;
-            blockEntry->isDirty = 1;
-        } 
-        else {
-            // Read from a full block
-            CopyFrom(senderPid, blockData, buf + bytesWrite, BLOCKSIZE);
-            bytesWrite += BLOCKSIZE;
-            blockEntry->isDirty = 1;
+
+        if (CopyFrom(senderPid, (char*)blockEntry->data + offsetInBlock, (char*)buf + bytesWrite, bytesToWrite) == ERROR) {
+            TracePrintf(0, "YfsWrite: Error copying data from process %d\n", senderPid);
+            msg->type = ERROR;
+            Reply((void*)msg, senderPid);
+            return;
         }
+        bytesWrite += bytesToWrite;
+        MarkBlockEntryDirty(blockEntry);
     }
 
     TracePrintf(0, "YfsWrite: Wrote %d bytes to file (inode %d)\n", bytesWrite, inodeNumber);
-    inodeInfo->size = offset + bytesWrite;
-    inodeEntry->isDirty = 1;
+    // Overwriting data inside the file must not shrink it
+    if (offset + bytesWrite > inodeInfo->size) {
+        inodeInfo->size = offset + bytesWrite;
+    }
+    MarkInodeEntryDirty(inodeEntry);
     msg->data1 = bytesWrite;
     Reply((void*)msg, senderPid);
     return;
@@ -588,6 +703,7 @@ void YfsLink(YfsMsg* msg, int senderPid) {
         Reply((void*)msg, senderPid);
         return;
     }
+    PinInode(oldInodeEntry);
 
     // check if the oldInode is a directory
     if (oldInodeEntry->inodeInfo->type == INODE_DIRECTORY) {
@@ -611,12 +727,13 @@ void YfsLink(YfsMsg* msg, int senderPid) {
 
     // check if newname's parent inode is a directory and exist
     struct InodeCacheEntry* newnodeParentInodeEntry = GetInodeFromCache(newParentInum);
-    if (newnodeParentInodeEntry->inodeInfo->type != INODE_DIRECTORY || newnodeParentInodeEntry == NULL) {
+    if (newnodeParentInodeEntry == NULL || newnodeParentInodeEntry->inodeInfo->type != INODE_DIRECTORY) {
         TracePrintf(0, "YfsLink: Error: newname %s is not a directory\n", newname);
         msg->type = ERROR;
         Reply((void*)msg, senderPid);
         return;
     }
+    PinInode(newnodeParentInodeEntry);
 
     struct InodeCacheEntry* oldnodeParentInodeEntry = GetInodeFromCache(oldInodeEntry->inodeNumber);
     if (oldnodeParentInodeEntry == NULL) {
@@ -652,7 +769,7 @@ void YfsLink(YfsMsg* msg, int senderPid) {
     }
 
     oldInodeEntry->inodeInfo->nlink += 1;
-    oldInodeEntry->isDirty = 1;
+    MarkInodeEntryDirty(oldInodeEntry);
 
     msg->type = 0;
     Reply((void*)msg, senderPid);
@@ -699,12 +816,13 @@ void YfsUnlink(YfsMsg* msg, int senderPid) {
     // get the filename from pathname
     char* filename = getFilename(pathname);
     struct InodeCacheEntry* parentInodeEntry = GetInodeFromCache(parentInum);
-    if (parentInodeEntry->inodeInfo->type != INODE_DIRECTORY) {
+    if (parentInodeEntry == NULL || parentInodeEntry->inodeInfo->type != INODE_DIRECTORY) {
         TracePrintf(0, "YfsUnlink: Parent inode is not a directory\n");
         msg->type = ERROR;
         Reply((void*)msg, senderPid);
         return;
     }
+    PinInode(parentInodeEntry);
 
     // check if the file exists
     int fileInum = GetInumByComponentName(parentInodeEntry, filename);
@@ -741,7 +859,7 @@ void YfsUnlink(YfsMsg* msg, int senderPid) {
     }
 
     fileInodeEntry->inodeInfo->nlink -= 1;
-    fileInodeEntry->isDirty = 1;
+    MarkInodeEntryDirty(fileInodeEntry);
 
     // If the file has no more links, free the inode
     if (fileInodeEntry->inodeInfo->nlink == 0) {
@@ -750,11 +868,10 @@ void YfsUnlink(YfsMsg* msg, int senderPid) {
         TruncateFile(fileInodeEntry);
 
         fileInodeEntry->inodeInfo->type = INODE_FREE;
-        fileInodeEntry->isDirty = 1;
+        MarkInodeEntryDirty(fileInodeEntry);
 
         // Add the inode to the free inode list
-        freeInodesList[fileInum] = 1;
-        freeInodesCount += 1;
+        FreeInode(fileInum);
         TracePrintf(0, "YfsUnlink: Added inode %d to free inodes list\n", fileInum);
     }
 
@@ -829,6 +946,7 @@ void YfsSymLink(YfsMsg* msg, int senderPid) {
         Reply((void*)msg, senderPid);
         return;
     }
+    PinInode(parentInodeEntry);
 
     // checking if newname already exists
     int existingInum = GetInumByComponentName(parentInodeEntry, newFilename);
@@ -872,30 +990,37 @@ void YfsSymLink(YfsMsg* msg, int senderPid) {
         symlinkInode->direct[i] = 0;
     }
 
-    // allocate a block to store the symlink target
-    int dataBlockNum = AllocateBlock();
-    if (dataBlockNum == ERROR) {
-        TracePrintf(0, "YfsSymLink: Error allocating data block, freeing symlinkInode\n");
-        
-        symlinkInode->type = INODE_FREE;
-        symlinkInodeEntry->isDirty = 1;
-        freeInodesList[symlinkInum] = 1;
-        freeInodesCount += 1;
-        
-        msg->type = ERROR;
-        Reply((void*)msg, senderPid);
-        return;
-    }
+    // a short target is stored inline, in place of the direct blocks
+    int dataBlockNum = 0;
+    if (symlinkInode->size <= INLINE_DATA_SIZE) {
+        SetInlineData(symlinkInode, oldname, symlinkInode->size);
+        MarkInodeEntryDirty(symlinkInodeEntry);
+    }
+    else {
+        // allocate a block to store the symlink target
+        dataBlockNum = AllocateBlock();
+        if (dataBlockNum == ERROR) {
+            TracePrintf(0, "YfsSymLink: Error allocating data block, freeing symlinkInode\n");
+            
+            symlinkInode->type = INODE_FREE;
+            MarkInodeEntryDirty(symlinkInodeEntry);
+            FreeInode(symlinkInum);
+            
+            msg->type = ERROR;
+            Reply((void*)msg, senderPid);
+            return;
+        }
 
-    // set the first direct block for storing the symlink target
-    symlinkInode->direct[0] = dataBlockNum;
-    symlinkInodeEntry->isDirty = 1;
+        // set the first direct block for storing the symlink target
+        symlinkInode->direct[0] = dataBlockNum;
+        MarkInodeEntryDirty(symlinkInodeEntry);
 
-    // save the oldname in the allocated block
-    // and mark the block as dirty
-    struct BlockCacheEntry* blockEntry = GetBlockFromCache(dataBlockNum);
-    memcpy(blockEntry->data, oldname, strlen(oldname));
-    blockEntry->isDirty = 1;
+        // save the oldname in the allocated block
+        // and mark the block as dirty
+        struct BlockCacheEntry* blockEntry = GetBlockFromCache(dataBlockNum);
+        memcpy(blockEntry->data, oldname, strlen(oldname));
+        MarkBlockEntryDirty(blockEntry);
+    }
 
     // add the symlink to the parent directory
     if (AddDirEntry(symlinkInum, newFilename, parentInodeEntry) == ERROR) {
@@ -903,15 +1028,15 @@ void YfsSymLink(YfsMsg* msg, int senderPid) {
         
         // if adddirentry failed, free the inode block
         symlinkInode->type = INODE_FREE;
-        symlinkInodeEntry->isDirty = 1;
-        freeInodesList[symlinkInum] = 1;
-        freeInodesCount += 1;
+        MarkInodeEntryDirty(symlinkInodeEntry);
+        FreeInode(symlinkInum);
         
-        // release the allocated data block
+        // release the allocated data block, if the target was not inline
         // clear the direct block
-        symlinkInode->direct[0] = 0;
-        freeInodesList[dataBlockNum] = 1;
-        freeBlocksCount += 1;
+        if (dataBlockNum > 0) {
+            symlinkInode->direct[0] = 0;
+            FreeBlock(dataBlockNum);
+        }
         msg->type = ERROR;
         Reply((void*)msg, senderPid);
         return;
@@ -979,6 +1104,23 @@ void YfsReadLink(YfsMsg* msg, int senderPid) {
         return;
     }
 
+    int len = msg->data3;
+    int linkSize = inodeEntry->inodeInfo->size;
+    int bytesToCopy = (linkSize < len) ? linkSize : len;
+
+    // a short target is stored inline
+    if (HasInlineData(inodeEntry->inodeInfo)) {
+        if (CopyTo(senderPid, msg->addr2, GetInlineData(inodeEntry->inodeInfo), bytesToCopy) == ERROR) {
+            TracePrintf(0, "YfsReadLink: Error copying link target to client\n");
+            msg->type = ERROR;
+            Reply((void*)msg, senderPid);
+            return;
+        }
+        msg->data1 = bytesToCopy;
+        Reply((void*)msg, senderPid);
+        return;
+    }
+
     int dataBlockNum = inodeEntry->inodeInfo->direct[0];
     if (dataBlockNum == 0) {
         TracePrintf(0, "YfsReadLink: Error: symbolic link %s has no data block\n", pathname);
@@ -995,10 +1137,6 @@ void YfsReadLink(YfsMsg* msg, int senderPid) {
         return;
     }
 
-    int len = msg->data3;
-    int linkSize = inodeEntry->inodeInfo->size;
-    int bytesToCopy = (linkSize < len) ? linkSize : len;
-
     if (CopyTo(senderPid, msg->addr2, blockEntry->data, bytesToCopy) == ERROR) {
         TracePrintf(0, "YfsReadLink: Error copying link target to client\n");
         msg->type = ERROR;
@@ -1056,6 +1194,7 @@ void YfsMkDir(YfsMsg* msg, int senderPid) {
         Reply((void*)msg, senderPid);
         return;
     }
+    PinInode(parentInodeEntry);
 
     int existingInum = GetInumByComponentName(parentInodeEntry, dirName);
 
@@ -1093,7 +1232,7 @@ void YfsMkDir(YfsMsg* msg, int senderPid) {
     for (int i = 0; i < NUM_DIRECT; i++) {
         newDirInode->direct[i] = 0;
     }
-    newDirInodeEntry->isDirty = 1;
+    MarkInodeEntryDirty(newDirInodeEntry);
 
     int dataBlockNum = AllocateBlock();
     if (dataBlockNum == ERROR) {
@@ -1101,9 +1240,8 @@ void YfsMkDir(YfsMsg* msg, int senderPid) {
 
         // Free the inode if block allocation fails
         newDirInode->type = INODE_FREE;
-        newDirInodeEntry->isDirty = 1;
-        freeInodesList[newDirInum] = 1;
-        freeInodesCount += 1;
+        MarkInodeEntryDirty(newDirInodeEntry);
+        FreeInode(newDirInum);
 
         msg->type = ERROR;
         Reply((void*)msg, senderPid);
@@ -1118,11 +1256,9 @@ void YfsMkDir(YfsMsg* msg, int senderPid) {
         // Free the inode and data block if adding directory entry fails
         newDirInode->type = INODE_FREE;
         newDirInode->direct[0] = 0;
-        newDirInodeEntry->isDirty = 1;
-        freeInodesList[newDirInum] = 1;
-        freeInodesCount += 1;
-        freeBlocksList[dataBlockNum] = 1;
-        freeBlocksCount += 1;
+        MarkInodeEntryDirty(newDirInodeEntry);
+        FreeInode(newDirInum);
+        FreeBlock(dataBlockNum);
 
         msg->type = ERROR;
         Reply((void*)msg, senderPid);
@@ -1130,7 +1266,7 @@ void YfsMkDir(YfsMsg* msg, int senderPid) {
     }
 
     parentInodeEntry->inodeInfo->nlink += 1;
-    parentInodeEntry->isDirty = 1;
+    MarkInodeEntryDirty(parentInodeEntry);
 
     // Add "." and ".." entries to the new directory
     struct BlockCacheEntry* blockEntry = GetBlockFromCache(dataBlockNum);
@@ -1147,7 +1283,7 @@ void YfsMkDir(YfsMsg* msg, int senderPid) {
     dotEntry->inum = newDirInum;
     dotdotEntry->inum = parentInum;
 
-    blockEntry->isDirty = 1;
+    MarkBlockEntryDirty(blockEntry);
 
     msg->type = 0;
     Reply((void*)msg, senderPid);
@@ -1196,6 +1332,7 @@ void YfsRmDir(YfsMsg* msg, int senderPid) {
         Reply((void*)msg, senderPid);
         return;
     }
+    PinInode(parentInodeEntry);
 
     char* dirName = getFilename(pathname);
     
@@ -1242,51 +1379,16 @@ void YfsRmDir(YfsMsg* msg, int senderPid) {
     // Check if there are entries other than . and .. that are valid, if yes, return ERROR 
     // The directory must contain no directory entries other than the “.” and “..” entries, 
     // and possibly some free entries (spec p.18)
-    struct inode* dirInode = dirInodeEntry->inodeInfo;
-    int totalDirEntries = dirInode->size / sizeof(struct dir_entry);
-
-    int i;
-    // Traverse the directory entries
-    for (i = 0; i < totalDirEntries; i++) {
-        // Get the block number of this directory entry
-        int index = i / DIRENTRY_PER_BLOCK;
-        if (index >= NUM_DIRECT && dirInode->indirect == 0) {
-            msg->type = ERROR;
-            Reply((void*)msg, senderPid);
-            return;
-        }
-        int blockNumber;
-        // The entry is using the direct block
-        if (index < NUM_DIRECT) {
-            blockNumber = dirInode->direct[index];
-        }
-        // The entry is using the indirect block
-        else {
-            blockNumber = GetDataBlockNumberFromIndirectBlock(dirInode->indirect, index - NUM_DIRECT);
-        }
-        
-        // Get the data block from the cache and check the directory entry
-        struct BlockCacheEntry* block = GetBlockFromCache(blockNumber);
-        if (block == NULL) {
-            msg->type = ERROR;
-            Reply((void*)msg, senderPid);
-            return;
-        }
-        void *blockData = block->data;
-        struct dir_entry *dirEntry = (struct dir_entry *)(blockData + (i % DIRENTRY_PER_BLOCK) * sizeof(struct dir_entry));
-        // If the entry is valid and not . or .., return ERROR
-        if (dirEntry->inum > 0) {
-            TracePrintf(0, "YfsRmDir: Found valid directory entry %s\n", dirEntry->name);
-            if ( (dirEntry->name[0] == '.' && dirEntry->name[1] == '\0') || (dirEntry->name[1] == '.' && dirEntry->name[2] == '\0')) {
-                TracePrintf(0, "YfsRmDir: Found . or .. entry, skipping\n");
-                continue;
-            } else {
-                TracePrintf(0, "YfsRmDir: Directory is not empty, contains entry '%s'\n", dirEntry->name);
-                msg->type = ERROR;
-                Reply((void*)msg, senderPid);
-                return;
-            }
-        }
+    if (LoadDirectoryMetadata(dirInodeEntry) == ERROR) {
+        msg->type = ERROR;
+        Reply((void*)msg, senderPid);
+        return;
+    }
+    if (dirInodeEntry->dirEntryCount > 0) {
+        TracePrintf(0, "YfsRmDir: Directory is not empty, contains %d entries\n", dirInodeEntry->dirEntryCount);
+        msg->type = ERROR;
+        Reply((void*)msg, senderPid);
+        return;
     }
 
     // Remove the directory entry from the parent inode
@@ -1300,16 +1402,15 @@ void YfsRmDir(YfsMsg* msg, int senderPid) {
 
     // Decrease the link count of the parent inode
     parentInodeEntry->inodeInfo->nlink -= 1;
-    parentInodeEntry->isDirty = 1;
+    MarkInodeEntryDirty(parentInodeEntry);
 
     // Free the directory inode
     // Clear the data block of this inode
     TruncateFile(dirInodeEntry);
     // Mark the inode as free
     dirInodeEntry->inodeInfo->type = INODE_FREE;
-    dirInodeEntry->isDirty = 1;
-    freeInodesList[dirInum] = 1;
-    freeInodesCount += 1;
+    MarkInodeEntryDirty(dirInodeEntry);
+    FreeInode(dirInum);
 
     TracePrintf(0, "YfsRmDir: Removed directory %s successfully\n", pathname);
 
@@ -1426,7 +1527,8 @@ void YfsStat(YfsMsg* msg, int senderPid) {
 
 void YfsSync(YfsMsg* msg, int senderPid) {
     TracePrintf(0, "YfsSync: Received message from process %d\n", senderPid);
-    // Flush all modified data to the disk
+    // Flush all modified data to the disk. The free maps are only checkpointed on Shutdown: the server keeps
+    // allocating after a Sync, so a checkpoint marked clean now would be stale after a crash
     SyncCache();
 
     // Reply to the sender process so that it can continue
@@ -1436,14 +1538,21 @@ void YfsSync(YfsMsg* msg, int senderPid) {
 
 void YfsShutDown(YfsMsg* msg, int senderPid) {
     TracePrintf(0, "YfsShutDown: Received message from process %d\n", senderPid);
-    // Flush all modified data to the disk
+    // Flush all modified data to the disk, then checkpoint the free maps and mark the file system clean
     SyncCache();
+    CheckpointFreeMaps();
 
     // Reply to the sender process so that it can continue
     msg->type = 0;
     Reply((void*)msg, senderPid);
 
     // Server should print informative message indicating it is shutting down
+    PrintBlockCacheStats();
+    PrintInodeCacheStats();
+    PrintBlockMapStats();
+    PrintFragmentationStats();
+    PrintFreeMapStats();
+    PrintNameCacheStats();
     TracePrintf(0, "YfsShutDown: Shutting down file server process\n");
     printf("ShutDown called by process %d, YFS server shutting down...\n", senderPid);
 